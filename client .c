@@ -8,6 +8,37 @@
 #define PORT 8080
 #define BUFFER_SIZE 2048
 
+// Reads one whole reply; the server ends every reply with a NUL byte.
+// The returned buffer is reused by the next call.
+char *read_reply(int sock) {
+    static char *reply = NULL;
+    static size_t cap = 0;
+    size_t len = 0;
+
+    while(1) {
+        if(cap - len < BUFFER_SIZE) {
+            size_t grown = cap ? cap * 2 : BUFFER_SIZE * 2;
+            char *p = realloc(reply, grown);
+            if(!p) break;
+            reply = p;
+            cap = grown;
+        }
+        ssize_t n = recv(sock, reply + len, cap - len - 1, 0);
+        if(n <= 0) break;
+        len += n;
+        if(reply[len - 1] == '\0') return reply;
+    }
+
+    if(!reply || len == 0) {
+        // Callers tokenize the reply in place, so hand back a writable copy
+        static char lost[32];
+        strcpy(lost, "ERR|Connection lost");
+        return lost;
+    }
+    reply[len] = '\0';
+    return reply;
+}
+
 // Prints the menu options based on whether the user is authenticated or not
 void print_menu(int authenticated) {
     printf("\nMenu:\n");
@@ -131,8 +162,8 @@ int main() {
                 send(sock, buffer, strlen(buffer), 0);
 
                 // Get server response
-                recv(sock, buffer, BUFFER_SIZE, 0);
-                printf("Server: %s\n", strchr(buffer, '|') + 1);
+                char *reply = read_reply(sock);
+                printf("Server: %s\n", strchr(reply, '|') + 1);
                 break;
             }
 
@@ -154,19 +185,18 @@ int main() {
                 send(sock, buffer, strlen(buffer), 0);
 
                 // Receive response
-                recv(sock, buffer, BUFFER_SIZE, 0);
-                buffer[BUFFER_SIZE-1] = '\0';
+                char *reply = read_reply(sock);
 
                 // Parse response to determine login status
-                if(strncmp(buffer, "OK", 2) == 0) {
-                    char *name = strchr(buffer, '|') + 1;
+                if(strncmp(reply, "OK", 2) == 0) {
+                    char *name = strchr(reply, '|') + 1;
                     char *credits = strchr(name, '|') + 1;
                     *strchr(name, '|') = '\0';
                     printf("Welcome %s (Credits: %s)\n", name, credits);
                     strcpy(username, name);
                     authenticated = 1;
                 } else {
-                    printf("Error: %s\n", strchr(buffer, '|') + 1);
+                    printf("Error: %s\n", strchr(reply, '|') + 1);
                 }
                 break;
             }
@@ -182,9 +212,9 @@ int main() {
 
                 snprintf(buffer, sizeof(buffer), "POST|%s", question);
                 send(sock, buffer, strlen(buffer), 0);
-                recv(sock, buffer, BUFFER_SIZE, 0);
+                char *reply = read_reply(sock);
 
-                printf("Server: %s\n", strchr(buffer, '|') + 1);
+                printf("Server: %s\n", strchr(reply, '|') + 1);
                 break;
             }
 
@@ -193,8 +223,7 @@ int main() {
                 if(!authenticated) break;
 
                 send(sock, "LISTQ", 5, 0);
-                recv(sock, buffer, BUFFER_SIZE, 0);
-                display_questions(buffer);
+                display_questions(read_reply(sock));
                 break;
             }
 
@@ -213,9 +242,9 @@ int main() {
 
                 snprintf(buffer, sizeof(buffer), "ANSWER|%s|%s", qnum, answer);
                 send(sock, buffer, strlen(buffer), 0);
-                recv(sock, buffer, BUFFER_SIZE, 0);
+                char *reply = read_reply(sock);
 
-                printf("Server: %s\n", strchr(buffer, '|') + 1);
+                printf("Server: %s\n", strchr(reply, '|') + 1);
                 break;
             }
 
@@ -230,9 +259,7 @@ int main() {
 
                 snprintf(buffer, sizeof(buffer), "SEARCH|%s", query);
                 send(sock, buffer, strlen(buffer), 0);
-                recv(sock, buffer, BUFFER_SIZE, 0);
-
-                display_search_results(buffer);
+                display_search_results(read_reply(sock));
                 break;
             }
 
@@ -256,9 +283,9 @@ int main() {
 
                 snprintf(buffer, sizeof(buffer), "RATE|%s|%s|%s", qid, aid, rating);
                 send(sock, buffer, strlen(buffer), 0);
-                recv(sock, buffer, BUFFER_SIZE, 0);
+                char *reply = read_reply(sock);
 
-                printf("Server: %s\n", strchr(buffer, '|') + 1);
+                printf("Server: %s\n", strchr(reply, '|') + 1);
                 break;
             }
 
@@ -268,9 +295,9 @@ int main() {
 
                 snprintf(buffer, sizeof(buffer), "LEADER");
                 send(sock, buffer, strlen(buffer), 0);
-                recv(sock, buffer, BUFFER_SIZE, 0);
+                char *reply = read_reply(sock);
 
-                printf("\n--- Leaderboard ---\n%s\n", strchr(buffer, '|') + 1);
+                printf("\n--- Leaderboard ---\n%s\n", strchr(reply, '|') + 1);
                 break;
             }
 
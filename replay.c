@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#define PORT 8080
+#define BUFFER_SIZE 2048
+#define CAPTURE_MAGIC "QACAP01"
+#define REPLY_TIMEOUT 5     // seconds to wait for each server reply
+#define MAX_RECORD (1 << 20) // largest record accepted from a trace (BATCH bodies)
+
+// Capture record types (must match server.c)
+enum {
+    CAPTURE_OPEN = 1,
+    CAPTURE_CMD,
+    CAPTURE_CLOSE
+};
+
+// Trace record header (must match server.c)
+typedef struct {
+    int64_t  ts_us;
+    uint64_t conn;
+    uint32_t type;
+    uint32_t len;
+} CaptureRecord;
+
+// One captured event with its payload (rec.len bytes plus a NUL)
+typedef struct {
+    CaptureRecord rec;
+    char data[];
+} Event;
+
+// All events of one captured connection, replayed by one thread
+typedef struct {
+    uint64_t conn;
+    Event **events;
+    int count;
+    int cap;
+
+    // Results
+    int sent;
+    int errors;       // replies starting with ERR
+    int timeouts;     // no reply within REPLY_TIMEOUT
+    int64_t *latency_us;
+} Connection;
+
+const char *host     = "127.0.0.1";
+int         port     = PORT;
+double      speed    = 1.0;    // 0 = as fast as possible
+const char *password = NULL;   // substituted for redacted passwords
+
+int64_t trace_start_us;        // timestamp of the first event in the trace
+struct timespec replay_start;  // monotonic time replay began
+
+// Loads every event of the trace and groups them by connection id
+Connection *load_trace(const char *path, int *conn_count) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    char magic[sizeof(CAPTURE_MAGIC)];
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+        memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "%s: not a capture trace\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    Connection *conns = NULL;
+    int count = 0, cap = 0;
+    int first = 1;
+
+    while (1) {
+        CaptureRecord rec;
+        if (fread(&rec, sizeof(rec), 1, fp) != 1 || rec.len > MAX_RECORD) break;
+        Event *ev = malloc(sizeof(Event) + rec.len + 1);
+        if (!ev) {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        ev->rec = rec;
+        if (fread(ev->data, 1, rec.len, fp) != rec.len) {
+            free(ev);      // end of trace (or a truncated final record)
+            break;
+        }
+        ev->data[ev->rec.len] = '\0';
+        if (first) {
+            trace_start_us = ev->rec.ts_us;
+            first = 0;
+        }
+
+        // Find the connection this event belongs to (most recent first)
+        Connection *c = NULL;
+        for (int i = count - 1; i >= 0; i--) {
+            if (conns[i].conn == ev->rec.conn) {
+                c = &conns[i];
+                break;
+            }
+        }
+        if (!c) {
+            if (count == cap) {
+                cap   = cap ? cap * 2 : 64;
+                conns = realloc(conns, sizeof(Connection) * cap);
+            }
+            c = &conns[count++];
+            memset(c, 0, sizeof(*c));
+            c->conn = ev->rec.conn;
+        }
+        if (c->count == c->cap) {
+            c->cap    = c->cap ? c->cap * 2 : 16;
+            c->events = realloc(c->events, sizeof(Event *) * c->cap);
+        }
+        c->events[c->count++] = ev;
+    }
+
+    fclose(fp);
+    *conn_count = count;
+    return conns;
+}
+
+// Sleeps until the event's offset in the trace, scaled by speed
+void wait_for(const Event *ev) {
+    if (speed <= 0) return;
+
+    int64_t offset_ns = (int64_t)((ev->rec.ts_us - trace_start_us) * 1000 / speed);
+    struct timespec due = replay_start;
+    due.tv_sec  += offset_ns / 1000000000;
+    due.tv_nsec += offset_ns % 1000000000;
+    if (due.tv_nsec >= 1000000000) {
+        due.tv_sec++;
+        due.tv_nsec -= 1000000000;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) != 0);
+}
+
+int64_t elapsed_us(const struct timespec *from) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(now.tv_sec - from->tv_sec) * 1000000 +
+           (now.tv_nsec - from->tv_nsec) / 1000;
+}
+
+// Opens a TCP connection to the server under test
+int open_connection() {
+    struct sockaddr_in serv_addr;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port   = htons(port);
+    if (inet_pton(AF_INET, host, &serv_addr.sin_addr) <= 0 ||
+        connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    struct timeval tv = { REPLY_TIMEOUT, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return sock;
+}
+
+// Sends the whole command; BATCH records can exceed one send()
+void send_all(int sock, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(sock, data, len, MSG_NOSIGNAL);
+        if (n <= 0) return;
+        data += n;
+        len  -= n;
+    }
+}
+
+// Reads one whole reply (the server ends each with a NUL byte) and reports
+// whether it was an ERR. Returns -1 on timeout or a closed connection.
+int read_reply(int sock, int *is_err) {
+    char buffer[BUFFER_SIZE];
+    int first = 1;
+
+    while (1) {
+        ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+        if (n <= 0) return -1;
+        if (first) *is_err = n >= 3 && strncmp(buffer, "ERR", 3) == 0;
+        first = 0;
+        if (buffer[n - 1] == '\0') return 0;
+    }
+}
+
+// Replays one connection's events in order; one request in flight at a time
+void *replay_connection(void *arg) {
+    Connection *c = (Connection *)arg;
+    char buffer[BUFFER_SIZE];
+    int sock = -1;
+
+    c->latency_us = malloc(sizeof(int64_t) * (c->count ? c->count : 1));
+
+    for (int i = 0; i < c->count; i++) {
+        Event *ev = c->events[i];
+        wait_for(ev);
+
+        if (ev->rec.type == CAPTURE_CLOSE) {
+            if (sock >= 0) close(sock);
+            sock = -1;
+            continue;
+        }
+        if (sock < 0 && (sock = open_connection()) < 0) {
+            fprintf(stderr, "conn %llu: connection failed\n",
+                    (unsigned long long)c->conn);
+            return NULL;
+        }
+        if (ev->rec.type != CAPTURE_CMD) continue;
+
+        // Restore redacted passwords: REGISTER|user|* / LOGIN|user|*
+        const char *out = ev->data;
+        size_t len = ev->rec.len;
+        if (password && len >= 2 && len < sizeof(buffer) &&
+            strcmp(ev->data + len - 2, "|*") == 0 &&
+            (strncmp(ev->data, "REGISTER|", 9) == 0 || strncmp(ev->data, "LOGIN|", 6) == 0)) {
+            memcpy(buffer, ev->data, len + 1);
+            len = len - 1 + snprintf(buffer + len - 1, sizeof(buffer) - len + 1,
+                                     "%s", password);
+            if (len >= sizeof(buffer)) len = sizeof(buffer) - 1;
+            out = buffer;
+        }
+
+        struct timespec sent_at;
+        clock_gettime(CLOCK_MONOTONIC, &sent_at);
+        send_all(sock, out, len);
+
+        int is_err;
+        int rc = read_reply(sock, &is_err);
+        c->latency_us[c->sent++] = elapsed_us(&sent_at);
+        if (rc < 0) {
+            c->timeouts++;
+        } else if (is_err) {
+            c->errors++;
+        }
+    }
+
+    if (sock >= 0) close(sock);
+    return NULL;
+}
+
+int compare_latency(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--host IP] [--port N] [--speed X] [--password PW] TRACE\n"
+            "  --speed X      replay at X times captured speed (0 = no delays)\n"
+            "  --password PW  password sent in place of redacted REGISTER/LOGIN ones\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    const char *trace = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--host") == 0 && i + 1 < argc) {
+            host = argv[++i];
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--password") == 0 && i + 1 < argc) {
+            password = argv[++i];
+        } else if (argv[i][0] != '-' && !trace) {
+            trace = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (!trace) usage(argv[0]);
+
+    int conn_count;
+    Connection *conns = load_trace(trace, &conn_count);
+    pthread_t *tids = malloc(sizeof(pthread_t) * (conn_count ? conn_count : 1));
+
+    // One thread per captured connection keeps its commands in order
+    clock_gettime(CLOCK_MONOTONIC, &replay_start);
+    for (int i = 0; i < conn_count; i++) {
+        pthread_create(&tids[i], NULL, replay_connection, &conns[i]);
+    }
+
+    int sent = 0, errors = 0, timeouts = 0;
+    for (int i = 0; i < conn_count; i++) {
+        pthread_join(tids[i], NULL);
+        sent     += conns[i].sent;
+        errors   += conns[i].errors;
+        timeouts += conns[i].timeouts;
+    }
+    double secs = elapsed_us(&replay_start) / 1e6;
+
+    // Merge per-connection latencies for percentiles
+    int64_t *lat = malloc(sizeof(int64_t) * (sent ? sent : 1));
+    int64_t total = 0;
+    int n = 0;
+    for (int i = 0; i < conn_count; i++) {
+        for (int j = 0; j < conns[i].sent; j++) {
+            lat[n++] = conns[i].latency_us[j];
+            total   += conns[i].latency_us[j];
+        }
+    }
+    qsort(lat, n, sizeof(int64_t), compare_latency);
+
+    printf("Replayed %d commands over %d connections in %.2fs (%.0f cmd/s)\n",
+           sent, conn_count, secs, secs > 0 ? sent / secs : 0.0);
+    printf("ERR replies: %d, timeouts: %d\n", errors, timeouts);
+    if (n > 0) {
+        printf("Latency us: avg %lld, p50 %lld, p99 %lld, max %lld\n",
+               (long long)(total / n),
+               (long long)lat[n / 2],
+               (long long)lat[(int)(n * 0.99)],
+               (long long)lat[n - 1]);
+    }
+    return 0;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE        // strcasestr, strndup
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,7 +6,19 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <signal.h>
 #include <openssl/sha.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #define PORT 8080
 #define MAX_CLIENTS 10
@@ -13,6 +26,27 @@
 #define MAX_USERS 100
 #define MAX_QUESTIONS 1000
 #define MAX_ANSWERS 20
+#define REPL_LOG_SLOTS 256       // mutation records kept for follower catch-up
+#define REPL_HEARTBEAT_MS 1000   // idle interval between primary heartbeats
+#define MAX_SESSIONS 256         // pooled ClientSession slots
+#define SESSION_READ_TIMEOUT 30  // seconds allowed before the first command
+#define SESSION_IDLE_TIMEOUT 300 // seconds allowed between commands
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 2           // 1s ticks: level 0 spans 64s, level 1 ~68min
+#define CACHE_BUDGET_DEFAULT (MAX_QUESTIONS / 4 * sizeof(Question))  // resident answer bytes, ~1/4 of a full store
+#define CAPTURE_SLOTS 1024       // capture ring size, must be a power of two
+#define CAPTURE_MAGIC "QACAP01"  // trace file header (8 bytes incl. NUL)
+#define SEARCH_WORKERS 4         // threads scanning slices of a large corpus
+#define SEARCH_PARALLEL_MIN (64 * 1024)  // corpus bytes before slicing pays off
+#define BATCH_MAX_OPS 1024       // operations accepted in one BATCH
+#define BATCH_MAX_BYTES (BATCH_MAX_OPS * 320)
+#define BATCH_HEADER_MAX 16      // room for "BATCH|<count>\n"
+#define CHECKPOINT_INTERVAL_MS 1000  // max age of unsaved credit/score changes
+#define IOL_COPY_MAX 64              // text shorter than this is copied, not referenced
+#define IOL_ROW_SCRATCH 128          // scratch bytes per LISTQ/SEARCH row
+#define SCORE_BUCKET_SECONDS 3600    // width of one rating bucket
+#define SCORE_BUCKETS (30 * 24)      // buckets kept, covers the monthly window
 
 // User record structure
 typedef struct {
@@ -23,7 +57,23 @@ typedef struct {
     int score;         // cumulative score from rated answers
 } User;
 
-// Question + answers structure
+// Copy of users[] taken under users_mutex and written to users.dat after
+// the lock is released
+typedef struct {
+    uint64_t version;  // snapshots are numbered in the order they are taken
+    int count;
+    User users[MAX_USERS];
+} UsersSnapshot;
+
+// Live credits/score of one user, padded to a cache line so concurrent
+// bumps to different users never contend. users[] holds the values as of
+// the last checkpoint.
+typedef struct {
+    _Atomic int credits;
+    _Atomic int score;
+} __attribute__((aligned(64))) UserCounters;
+
+// Question + answers structure (on-disk record in questions.dat)
 typedef struct {
     char question[256];
     char author[50];
@@ -33,92 +83,2379 @@ typedef struct {
     int ratings[MAX_ANSWERS];  // rating per answer
 } Question;
 
-// Per-connection session info
-typedef struct {
-    int sock;
-    struct sockaddr_in addr;
-    int user_idx;         // index into users[] array
-    int authenticated;    // 0 = not logged in, 1 = logged in
-} ClientSession;
+// Always-resident part of a question; answer bodies live in the cache
+typedef struct {
+    char question[256];
+    char author[50];
+    int answer_count;
+    int ratings[MAX_ANSWERS];  // rating per answer
+} QuestionHeader;
+
+// Answer bodies of one question, paged in from questions.dat on demand
+typedef struct AnswerSet {
+    int qidx;
+    int count;
+    char *text[MAX_ANSWERS];
+    char *author[MAX_ANSWERS];
+    size_t bytes;                  // footprint charged against the cache budget
+    int pins;                      // >0 while a handler is using the set
+    int referenced;                // CLOCK reference bit
+    struct AnswerSet *prev, *next; // CLOCK ring
+} AnswerSet;
+
+// Answer cache bookkeeping. Every cache operation already runs under
+// questions_mutex, so the cache relies on it instead of locks of its own.
+typedef struct {
+    AnswerSet *hand;               // CLOCK hand, NULL when the cache is empty
+    size_t bytes;
+    uint64_t hits, misses, evictions;
+} AnswerCache;
+
+// Substring kernel: first match of needle (length m) in [s, end) or NULL
+typedef const char *(*FindFn)(const char *s, const char *end,
+                              const char *needle, size_t m);
+
+// One slice of a parallel corpus scan
+typedef struct {
+    FindFn find;
+    const char *text;
+    size_t begin, end;     // byte range, cut at record boundaries
+    const char *needle;
+    size_t m;
+    size_t *hits;
+    size_t max_hits;
+    size_t nhits;
+} ScanJob;
+
+// Operation kinds accepted inside BATCH
+enum {
+    BATCH_POST = 1,
+    BATCH_ANSWER,
+    BATCH_RATE
+};
+
+// One parsed BATCH operation
+typedef struct {
+    int type;
+    int qidx, aidx, score;
+    char *text;            // points into the request body
+    int author_idx;        // RATE: users[] index of the answer author
+    char *text_copy;       // ANSWER: preallocated so applying cannot fail
+    char *author_copy;
+} BatchOp;
+
+// Capture record types
+enum {
+    CAPTURE_OPEN = 1,   // connection accepted, data = peer address
+    CAPTURE_CMD,        // command received, data = raw command
+    CAPTURE_CLOSE       // connection closed
+};
+
+// Trace record header, followed by len bytes of data (layout shared with replay.c)
+typedef struct {
+    int64_t  ts_us;     // server wall clock when the event happened
+    uint64_t conn;      // session id
+    uint32_t type;
+    uint32_t len;
+} CaptureRecord;
+
+// One slot of the capture ring (Vyukov bounded queue)
+typedef struct {
+    _Atomic size_t seq;
+    CaptureRecord rec;
+    char data[BUFFER_SIZE];
+    char *spill;          // heap copy of a record larger than data[], or NULL
+} CaptureSlot;
+
+// Per-connection session info, allocated from the session pool
+typedef struct ClientSession {
+    int sock;
+    struct sockaddr_in addr;
+    // Login state: written under sessions_mutex so SESSIONS can read it;
+    // the owning handler thread reads it without the lock
+    int user_idx;         // index into users[] array
+    int authenticated;    // 0 = not logged in, 1 = logged in
+
+    // Session table bookkeeping (guarded by sessions_mutex)
+    uint64_t id;          // connection id, unique for the process lifetime
+    int in_use;
+    int expired;          // timer fired; socket shut down, awaiting release
+    uint64_t connected_tick;
+    uint64_t active_tick; // tick of the last received command
+    struct ClientSession *next_free;
+
+    // Timer wheel linkage
+    struct ClientSession *timer_prev, *timer_next;
+    uint64_t timer_expires;   // tick at which the session times out
+    int timer_level;          // -1 when not scheduled
+    int timer_slot;
+} ClientSession;
+
+// One rating (or, in snapshots, one bucket's aggregate) for one user
+typedef struct {
+    int64_t ts;       // seconds since the epoch
+    int32_t user;
+    int32_t score;    // sum of the ratings
+    int32_t events;   // number of ratings
+} RatingEvent;
+
+// Ratings received by each user during one SCORE_BUCKET_SECONDS interval
+typedef struct {
+    int64_t id;               // ts / SCORE_BUCKET_SECONDS, -1 when unused
+    int nusers;               // users[] entries with events in this bucket
+    int users[MAX_USERS];
+    int delta[MAX_USERS];     // indexed by user
+    int events[MAX_USERS];
+} ScoreBucket;
+
+// Rolling aggregate over the newest `buckets` buckets, kept sorted by score
+typedef struct {
+    const char *name;
+    int buckets;
+    int score[MAX_USERS];
+    int events[MAX_USERS];
+    int rank[MAX_USERS];      // users with events in the window, best first
+    int pos[MAX_USERS];       // position of each ranked user in rank[]
+    int ranked;
+} ScoreWindow;
+
+enum {
+    WINDOW_DAILY = 0,
+    WINDOW_WEEKLY,
+    WINDOW_MONTHLY,
+    WINDOW_COUNT
+};
+
+// Reply assembled as fragments pointing at stored text, sent with sendmsg().
+// Short pieces (digits, separators, names) are copied into scratch instead,
+// where consecutive ones share a single fragment.
+typedef struct {
+    struct iovec *iov;
+    int count, cap;
+    char *scratch;
+    size_t used, scratch_cap;
+    char *rest;          // unsent tail, copied out so locks can be dropped
+    size_t rest_len;
+} IoList;
+
+// Global data and mutexes
+User users[MAX_USERS];
+QuestionHeader questions[MAX_QUESTIONS];
+int user_count = 0;
+int question_count = 0;
+
+pthread_mutex_t users_mutex     = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t questions_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t save_mutex      = PTHREAD_MUTEX_INITIALIZER;  // one users.dat writer at a time
+uint64_t users_version = 0;        // last snapshot taken, guarded by users_mutex
+
+UserCounters user_counters[MAX_USERS];
+_Atomic int  counters_dirty = 0;   // set by the first bump after a checkpoint
+
+// Windowed leaderboards, guarded by window_mutex (taken after users_mutex)
+ScoreBucket score_buckets[SCORE_BUCKETS];
+ScoreWindow score_windows[WINDOW_COUNT] = {
+    [WINDOW_DAILY]   = { .name = "Daily",   .buckets = 24 },
+    [WINDOW_WEEKLY]  = { .name = "Weekly",  .buckets = 7 * 24 },
+    [WINDOW_MONTHLY] = { .name = "Monthly", .buckets = SCORE_BUCKETS }
+};
+int64_t bucket_now = -1;                // id of the newest open bucket
+RatingEvent *pending_events = NULL;     // ratings not yet in ratings.log
+int pending_count = 0, pending_cap = 0;
+int ratings_log_fd = -1;                // primary only
+pthread_mutex_t window_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Tiered question store: headers above, answer bodies cached from disk
+AnswerSet *answer_sets[MAX_QUESTIONS];  // resident set or NULL
+AnswerCache answer_cache;               // guarded by questions_mutex
+size_t cache_budget = CACHE_BUDGET_DEFAULT;
+int segment_fd = -1;                    // questions.dat, read/written in place
+
+// Pre-encoded numbers for scatter-gather replies (indices, counts)
+char decimal_text[MAX_QUESTIONS + 1][8];
+unsigned char decimal_len[MAX_QUESTIONS + 1];
+
+// Search corpus: lower-cased question texts, NUL-separated, in index order
+char   search_corpus[MAX_QUESTIONS * 257];
+size_t corpus_off[MAX_QUESTIONS + 1];   // record i spans [off[i], off[i+1])
+size_t corpus_len   = 0;
+int    corpus_count = 0;
+FindFn search_find;                     // widest kernel the CPU supports
+
+// Worker pool for scanning large corpora
+struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    ScanJob *jobs;
+    int njobs, next, pending;
+} scan_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                PTHREAD_COND_INITIALIZER, NULL, 0, 0, 0 };
+
+// Replication roles: a primary accepts writes, a follower only serves reads
+typedef enum {
+    ROLE_PRIMARY = 0,
+    ROLE_FOLLOWER
+} ServerRole;
+
+// Record types shipped over the replication socket
+enum {
+    REPL_SNAPSHOT_BEGIN = 1,   // idx = user_count, count = question_count
+    REPL_SNAPSHOT_END,
+    REPL_USER,                 // payload: User stored at users[idx]
+    REPL_QUESTION,             // payload: Question stored at questions[idx]
+    REPL_HEARTBEAT,            // no payload, lsn = primary's latest LSN
+    REPL_RATING                // payload: RatingEvent
+};
+
+// Fixed header preceding every replication record on the wire
+typedef struct {
+    uint32_t type;
+    int32_t  idx;
+    int32_t  count;
+    uint32_t len;      // payload bytes following the header
+    uint64_t lsn;      // log sequence number of the record
+    uint64_t head_lsn; // primary's latest LSN when the record was sent
+    int64_t  ts_ms;    // primary wall clock when the record was produced
+} ReplHeader;
+
+// One slot of the primary's in-memory mutation log
+typedef struct {
+    ReplHeader hdr;
+    union {
+        User user;
+        Question question;
+        RatingEvent rating;
+    } body;
+} ReplRecord;
+
+ServerRole server_role = ROLE_PRIMARY;
+const char *repl_listen_path = NULL;   // primary: UNIX socket for followers
+const char *repl_follow_path = NULL;   // follower: primary's UNIX socket
+
+ReplRecord repl_log[REPL_LOG_SLOTS];
+uint64_t repl_lsn           = 0;   // primary: last appended, follower: last applied
+uint64_t repl_primary_lsn   = 0;   // follower: latest LSN announced by primary
+int64_t  repl_applied_ts_ms = 0;   // follower: primary timestamp of last applied record
+int64_t  repl_contact_ms    = 0;   // follower: local time of last message from primary
+int      repl_connected     = 0;   // follower: 1 while attached to the primary
+int      repl_followers     = 0;   // primary: number of attached followers
+
+pthread_mutex_t repl_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  repl_cond  = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Hash a plaintext password using SHA-256 and output as hex string.
+ */
+void hash_password(const char *password, char *output) {
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256((const unsigned char *)password, strlen(password), hash);
+    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        sprintf(output + i*2, "%02x", hash[i]);
+    }
+    output[SHA256_DIGEST_LENGTH*2] = '\0';
+}
+
+/**
+ * Byte offset of questions[qidx]'s record in the segment file.
+ */
+static off_t segment_offset(int qidx) {
+    return (off_t)sizeof(int) + (off_t)qidx * sizeof(Question);
+}
+
+/**
+ * Read a full Question record from the segment file.
+ */
+int store_read_record(int qidx, Question *q) {
+    ssize_t n = pread(segment_fd, q, sizeof(Question), segment_offset(qidx));
+    return n == (ssize_t)sizeof(Question) ? 0 : -1;
+}
+
+/**
+ * Write a full Question record and the current question_count.
+ * Caller holds questions_mutex.
+ */
+int store_write_record(int qidx, const Question *q) {
+    if (pwrite(segment_fd, q, sizeof(Question), segment_offset(qidx))
+            != (ssize_t)sizeof(Question)) return -1;
+    if (pwrite(segment_fd, &question_count, sizeof(int), 0) != sizeof(int))
+        return -1;
+    return 0;
+}
+
+/**
+ * Copy the always-resident header fields out of a full record.
+ */
+void header_from_record(QuestionHeader *h, const Question *q) {
+    memcpy(h->question, q->question, sizeof(h->question));
+    memcpy(h->author,   q->author,   sizeof(h->author));
+    h->answer_count = q->answer_count;
+    memcpy(h->ratings,  q->ratings,  sizeof(h->ratings));
+}
+
+/**
+ * Rebuild the full on-disk record from a header and its answer set.
+ */
+void store_assemble(int qidx, const AnswerSet *a, Question *out) {
+    const QuestionHeader *h = &questions[qidx];
+    memset(out, 0, sizeof(*out));
+    strncpy(out->question, h->question, sizeof(out->question)-1);
+    strncpy(out->author,   h->author,   sizeof(out->author)-1);
+    out->answer_count = h->answer_count;
+    memcpy(out->ratings, h->ratings, sizeof(out->ratings));
+    for (int i = 0; i < a->count; i++) {
+        strncpy(out->answers[i],        a->text[i],   sizeof(out->answers[i])-1);
+        strncpy(out->answer_authors[i], a->author[i], sizeof(out->answer_authors[i])-1);
+    }
+}
+
+/**
+ * Persist questions[qidx] together with its (pinned) answer set.
+ * Caller holds questions_mutex.
+ */
+int store_write_question(int qidx, const AnswerSet *a) {
+    Question q;
+    store_assemble(qidx, a, &q);
+    return store_write_record(qidx, &q);
+}
+
+/**
+ * Memory charged to the cache for one answer set.
+ */
+static size_t answer_set_bytes(const AnswerSet *a) {
+    size_t bytes = sizeof(AnswerSet);
+    for (int i = 0; i < a->count; i++) {
+        bytes += strlen(a->text[i]) + 1 + strlen(a->author[i]) + 1;
+    }
+    return bytes;
+}
+
+static void answer_set_free(AnswerSet *a) {
+    for (int i = 0; i < a->count; i++) {
+        free(a->text[i]);
+        free(a->author[i]);
+    }
+    free(a);
+}
+
+/**
+ * Insert a set just behind the CLOCK hand so it is inspected last.
+ */
+static void cache_link(AnswerSet *a) {
+    if (!answer_cache.hand) {
+        a->prev = a->next = a;
+        answer_cache.hand = a;
+    } else {
+        a->next = answer_cache.hand;
+        a->prev = answer_cache.hand->prev;
+        a->prev->next = a;
+        answer_cache.hand->prev = a;
+    }
+    answer_sets[a->qidx] = a;
+    answer_cache.bytes += a->bytes;
+}
+
+/**
+ * Remove a set from the CLOCK ring.
+ */
+static void cache_unlink(AnswerSet *a) {
+    if (a->next == a) {
+        answer_cache.hand = NULL;
+    } else {
+        a->prev->next = a->next;
+        a->next->prev = a->prev;
+        if (answer_cache.hand == a) answer_cache.hand = a->next;
+    }
+    answer_sets[a->qidx] = NULL;
+    answer_cache.bytes -= a->bytes;
+}
+
+/**
+ * CLOCK sweep: evict unpinned, unreferenced sets until the cache fits the
+ * budget. Bodies are written through on every mutation, so eviction never
+ * needs to write back.
+ */
+static void cache_evict() {
+    int spins = 0;
+
+    while (answer_cache.bytes > cache_budget && answer_cache.hand &&
+           spins < 2 * MAX_QUESTIONS) {
+        AnswerSet *a = answer_cache.hand;
+        answer_cache.hand = a->next;
+        if (a->pins || a->referenced) {
+            a->referenced = 0;
+            spins++;
+            continue;
+        }
+        cache_unlink(a);
+        answer_set_free(a);
+        answer_cache.evictions++;
+    }
+}
+
+/**
+ * Return the pinned answer set of questions[qidx], paging it in from the
+ * segment file on a miss. Returns NULL on I/O or allocation failure.
+ * Caller holds questions_mutex and must release the set with answers_put().
+ * A miss reads one record under that lock.
+ */
+AnswerSet *answers_get(int qidx) {
+    AnswerSet *a = answer_sets[qidx];
+    if (a) {
+        answer_cache.hits++;
+    } else {
+        answer_cache.misses++;
+        Question q;
+        a = calloc(1, sizeof(AnswerSet));
+        if (!a || store_read_record(qidx, &q) < 0) {
+            free(a);
+            return NULL;
+        }
+        a->qidx  = qidx;
+        a->count = q.answer_count;
+        for (int i = 0; i < a->count; i++) {
+            q.answers[i][sizeof(q.answers[i])-1] = '\0';
+            q.answer_authors[i][sizeof(q.answer_authors[i])-1] = '\0';
+            a->text[i]   = strdup(q.answers[i]);
+            a->author[i] = strdup(q.answer_authors[i]);
+        }
+        a->bytes = answer_set_bytes(a);
+        cache_link(a);
+    }
+    a->pins++;
+    a->referenced = 1;
+    cache_evict();
+    return a;
+}
+
+/**
+ * Create the empty, pinned answer set for a newly posted question.
+ * Caller holds questions_mutex.
+ */
+AnswerSet *answers_create(int qidx) {
+    AnswerSet *a = calloc(1, sizeof(AnswerSet));
+    if (!a) return NULL;
+    a->qidx       = qidx;
+    a->bytes      = sizeof(AnswerSet);
+    a->pins       = 1;
+    a->referenced = 1;
+
+    cache_link(a);
+    cache_evict();
+    return a;
+}
+
+/**
+ * Append an answer to a pinned set, taking ownership of the malloc'd
+ * author and text strings.
+ */
+void answers_attach(AnswerSet *a, char *au, char *t) {
+    a->text[a->count]   = t;
+    a->author[a->count] = au;
+    a->count++;
+    size_t bytes = answer_set_bytes(a);
+    answer_cache.bytes += bytes - a->bytes;
+    a->bytes = bytes;
+}
+
+/**
+ * Append an answer to a pinned set. Returns -1 if out of memory.
+ */
+int answers_append(AnswerSet *a, const char *author, const char *text) {
+    char *t  = strndup(text,   sizeof(((Question *)0)->answers[0]) - 1);
+    char *au = strndup(author, sizeof(((Question *)0)->answer_authors[0]) - 1);
+    if (!t || !au) {
+        free(t);
+        free(au);
+        return -1;
+    }
+    answers_attach(a, au, t);
+    return 0;
+}
+
+/**
+ * Unpin an answer set obtained from answers_get()/answers_create().
+ */
+void answers_put(AnswerSet *a) {
+    a->pins--;
+    cache_evict();
+}
+
+/**
+ * Drop the resident copy of questions[qidx] after its record was
+ * replaced on disk. Caller holds questions_mutex, so nobody has it pinned.
+ */
+void answers_invalidate(int qidx) {
+    AnswerSet *a = answer_sets[qidx];
+    if (a) {
+        cache_unlink(a);
+        answer_set_free(a);
+    }
+}
+
+/**
+ * Create an unlinked temporary segment file.
+ */
+int store_temp_file() {
+    char path[] = "/tmp/qa-segment-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("segment file failed");
+        exit(EXIT_FAILURE);
+    }
+    unlink(path);
+    return fd;
+}
+
+/**
+ * Use an anonymous temporary file as the segment (replica followers keep
+ * no persistent copy of their own).
+ */
+void store_open_anonymous() {
+    segment_fd = store_temp_file();
+}
+
+/**
+ * Scalar kernel: first occurrence of needle (m >= 1) in [s, end), or NULL.
+ */
+static const char *find_scalar(const char *s, const char *end,
+                               const char *needle, size_t m) {
+    if ((size_t)(end - s) < m) return NULL;
+    for (const char *last = end - m; s <= last; s++) {
+        if (s[0] == needle[0] && memcmp(s + 1, needle + 1, m - 1) == 0) return s;
+    }
+    return NULL;
+}
+
+#if defined(__x86_64__)
+/**
+ * SSE2 kernel: compare the needle's first and last bytes against 16
+ * candidate positions at once and verify only where both agree.
+ */
+static const char *find_sse2(const char *s, const char *end,
+                             const char *needle, size_t m) {
+    if (m == 1) return memchr(s, needle[0], end - s);
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last  = _mm_set1_epi8(needle[m - 1]);
+
+    while ((size_t)(end - s) >= m - 1 + 16) {
+        __m128i bf = _mm_loadu_si128((const __m128i *)s);
+        __m128i bl = _mm_loadu_si128((const __m128i *)(s + m - 1));
+        unsigned mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, bf), _mm_cmpeq_epi8(last, bl)));
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(s + bit + 1, needle + 1, m - 2) == 0) return s + bit;
+            mask &= mask - 1;
+        }
+        s += 16;
+    }
+    return find_scalar(s, end, needle, m);
+}
+
+/**
+ * AVX2 kernel: same first/last filter over 32 positions per step.
+ */
+__attribute__((target("avx2")))
+static const char *find_avx2(const char *s, const char *end,
+                             const char *needle, size_t m) {
+    if (m == 1) return memchr(s, needle[0], end - s);
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last  = _mm256_set1_epi8(needle[m - 1]);
+
+    while ((size_t)(end - s) >= m - 1 + 32) {
+        __m256i bf = _mm256_loadu_si256((const __m256i *)s);
+        __m256i bl = _mm256_loadu_si256((const __m256i *)(s + m - 1));
+        unsigned mask = _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, bf), _mm256_cmpeq_epi8(last, bl)));
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(s + bit + 1, needle + 1, m - 2) == 0) return s + bit;
+            mask &= mask - 1;
+        }
+        s += 32;
+    }
+    return find_sse2(s, end, needle, m);
+}
+#endif
+
+/**
+ * Pick the widest kernel the CPU supports.
+ */
+void search_init() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    search_find = __builtin_cpu_supports("avx2") ? find_avx2 : find_sse2;
+#else
+    search_find = find_scalar;
+#endif
+}
+
+/**
+ * Scan NUL-separated records in text[begin, end) and record the offset of
+ * the first match in each matching record, up to max_hits. The needle is
+ * already lower-cased, as is the text. Returns the number of hits.
+ */
+static size_t scan_range(FindFn find, const char *text, size_t begin, size_t end,
+                         const char *needle, size_t m,
+                         size_t *hits, size_t max_hits) {
+    const char *p = text + begin, *e = text + end;
+    size_t n = 0;
+
+    while (n < max_hits && p < e) {
+        const char *hit = m ? find(p, e, needle, m) : p;
+        if (!hit) break;
+        hits[n++] = hit - text;
+        // One hit per record: resume after the record's terminator
+        const char *nul = memchr(hit, '\0', e - hit);
+        if (!nul) break;
+        p = nul + 1;
+    }
+    return n;
+}
+
+/**
+ * Search worker: runs scan jobs handed out by scan_parallel().
+ */
+void *search_worker(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&scan_pool.lock);
+    while (1) {
+        while (scan_pool.next >= scan_pool.njobs) {
+            pthread_cond_wait(&scan_pool.work, &scan_pool.lock);
+        }
+        ScanJob *job = &scan_pool.jobs[scan_pool.next++];
+        pthread_mutex_unlock(&scan_pool.lock);
+
+        job->nhits = scan_range(job->find, job->text, job->begin, job->end,
+                                job->needle, job->m, job->hits, job->max_hits);
+
+        pthread_mutex_lock(&scan_pool.lock);
+        if (--scan_pool.pending == 0) pthread_cond_signal(&scan_pool.done);
+    }
+    return NULL;
+}
+
+static void search_pool_start() {
+    for (int i = 0; i < SEARCH_WORKERS; i++) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, search_worker, NULL);
+        pthread_detach(tid);
+    }
+}
+
+/**
+ * Scan text[0, len) like scan_range(). Corpora of SEARCH_PARALLEL_MIN bytes
+ * or more are cut at record boundaries into SEARCH_WORKERS slices that
+ * the worker pool scans concurrently; hits come back in text order.
+ */
+size_t scan_parallel(FindFn find, const char *text, size_t len,
+                     const char *needle, size_t m,
+                     size_t *hits, size_t max_hits) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    static pthread_mutex_t submit = PTHREAD_MUTEX_INITIALIZER;
+
+    if (len < SEARCH_PARALLEL_MIN) {
+        return scan_range(find, text, 0, len, needle, m, hits, max_hits);
+    }
+    pthread_once(&once, search_pool_start);
+
+    ScanJob jobs[SEARCH_WORKERS];
+    int njobs = 0;
+    size_t begin = 0;
+    for (int i = 0; i < SEARCH_WORKERS && begin < len; i++) {
+        size_t end = (i == SEARCH_WORKERS - 1) ? len : len / SEARCH_WORKERS * (i + 1);
+        if (end < begin) end = begin;
+        const char *nul = memchr(text + end, '\0', len - end);
+        end = nul ? (size_t)(nul - text) + 1 : len;
+
+        ScanJob *job = &jobs[njobs++];
+        job->find     = find;
+        job->text     = text;
+        job->begin    = begin;
+        job->end      = end;
+        job->needle   = needle;
+        job->m        = m;
+        job->hits     = malloc(sizeof(size_t) * max_hits);
+        job->max_hits = job->hits ? max_hits : 0;
+        job->nhits    = 0;
+        begin = end;
+    }
+
+    pthread_mutex_lock(&submit);
+    pthread_mutex_lock(&scan_pool.lock);
+    scan_pool.jobs    = jobs;
+    scan_pool.njobs   = njobs;
+    scan_pool.next    = 0;
+    scan_pool.pending = njobs;
+    pthread_cond_broadcast(&scan_pool.work);
+    while (scan_pool.pending > 0) {
+        pthread_cond_wait(&scan_pool.done, &scan_pool.lock);
+    }
+    scan_pool.njobs = scan_pool.next = 0;
+    pthread_mutex_unlock(&scan_pool.lock);
+    pthread_mutex_unlock(&submit);
+
+    size_t n = 0;
+    for (int i = 0; i < njobs; i++) {
+        for (size_t j = 0; j < jobs[i].nhits && n < max_hits; j++) {
+            hits[n++] = jobs[i].hits[j];
+        }
+        free(jobs[i].hits);
+    }
+    return n;
+}
+
+/**
+ * Lower-case ASCII copy, matching strcasestr() in the C locale.
+ */
+static void ascii_lower(char *dst, const char *src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        char c = src[i];
+        dst[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+}
+
+/**
+ * Keep the search corpus in step with questions[qidx]'s text.
+ * Appends new questions; rebuilds if an existing text changed.
+ * Caller holds questions_mutex.
+ */
+void corpus_update(int qidx) {
+    if (qidx == corpus_count) {
+        size_t n = strnlen(questions[qidx].question, sizeof(questions[qidx].question));
+        ascii_lower(search_corpus + corpus_len, questions[qidx].question, n);
+        corpus_len += n;
+        search_corpus[corpus_len++] = '\0';
+        corpus_off[++corpus_count] = corpus_len;
+        return;
+    }
+
+    if (qidx < corpus_count) {
+        char lower[sizeof(questions[qidx].question)];
+        size_t n = strnlen(questions[qidx].question, sizeof(lower));
+        ascii_lower(lower, questions[qidx].question, n);
+        if (corpus_off[qidx + 1] - corpus_off[qidx] == n + 1 &&
+            memcmp(search_corpus + corpus_off[qidx], lower, n) == 0) return;
+    }
+
+    corpus_count = 0;
+    corpus_len   = 0;
+    for (int i = 0; i < question_count; i++) corpus_update(i);
+}
+
+/**
+ * Find questions whose text contains keyword (ASCII case-insensitive).
+ * Writes up to max matching indices in ascending order; returns the count.
+ * Caller holds questions_mutex.
+ */
+int search_questions(const char *keyword, int *out, int max) {
+    char needle[BUFFER_SIZE];
+    size_t m = strnlen(keyword, sizeof(needle) - 1);
+    ascii_lower(needle, keyword, m);
+    needle[m] = '\0';
+
+    size_t hits[MAX_QUESTIONS];
+    if (max > MAX_QUESTIONS) max = MAX_QUESTIONS;
+    size_t n = scan_parallel(search_find, search_corpus, corpus_len,
+                             needle, m, hits, max);
+
+    // Map corpus offsets back to question indices (hits are ascending)
+    int q = 0;
+    for (size_t i = 0; i < n; i++) {
+        while (corpus_off[q + 1] <= hits[i]) q++;
+        out[i] = q;
+    }
+    return n;
+}
+
+/**
+ * --bench-search MB: time each kernel, and the worker pool, over a
+ * synthetic corpus of NUL-separated questions and report GB/s.
+ */
+void bench_search(size_t mb) {
+    static const char *words[] = {
+        "how", "do", "i", "the", "what", "is", "a", "pointer", "in", "c",
+        "why", "does", "my", "thread", "deadlock", "when", "socket", "closes",
+        "Memory", "Leak", "malloc", "free", "segfault", "array", "struct"
+    };
+    const int nwords = sizeof(words) / sizeof(words[0]);
+    size_t len = mb * 1024 * 1024;
+    char *text = malloc(len + 1);
+    char *raw  = malloc(len + 1);
+    size_t max_hits = len / 16;
+    size_t *hits = malloc(sizeof(size_t) * max_hits);
+    if (!text || !raw || !hits) {
+        perror("bench malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Build records of 20-200 bytes; plant the needle in about 1 in 50
+    srand(42);
+    size_t pos = 0;
+    while (pos + 256 < len) {
+        size_t target = pos + 20 + rand() % 180;
+        while (pos < target) {
+            const char *w = (rand() % 50 == 0) ? "Mutex-Guard" : words[rand() % nwords];
+            size_t wl = strlen(w);
+            memcpy(raw + pos, w, wl);
+            pos += wl;
+            raw[pos++] = ' ';
+        }
+        raw[pos++] = '\0';
+    }
+    len = pos;
+    ascii_lower(text, raw, len);
+
+    struct {
+        const char *name;
+        FindFn find;
+        int parallel;
+    } runs[] = {
+        { "scalar",   find_scalar, 0 },
+#if defined(__x86_64__)
+        { "sse2",     find_sse2,   0 },
+        { "avx2",     find_avx2,   0 },
+#endif
+        { "parallel", search_find, 1 },
+    };
+
+    printf("Search benchmark: %zu bytes, needle \"mutex-guard\"\n", len);
+    for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+#if defined(__x86_64__)
+        if (runs[r].find == find_avx2 && !__builtin_cpu_supports("avx2")) continue;
+#endif
+        struct timespec t0, t1;
+        size_t n = 0;
+        int iters = 0;
+        double secs = 0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        do {
+            n = runs[r].parallel
+                ? scan_parallel(runs[r].find, text, len, "mutex-guard", 11, hits, max_hits)
+                : scan_range(runs[r].find, text, 0, len, "mutex-guard", 11, hits, max_hits);
+            iters++;
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        } while (secs < 0.5);
+        printf("  %-8s %8.2f GB/s  (%zu matching records)\n",
+               runs[r].name, (double)len * iters / secs / 1e9, n);
+    }
+
+    // Reference: per-record strcasestr, as SEARCH used to do
+    {
+        struct timespec t0, t1;
+        size_t n = 0;
+        int iters = 0;
+        double secs = 0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        do {
+            n = 0;
+            for (const char *p = raw; p < raw + len; p += strlen(p) + 1) {
+                if (strcasestr(p, "mutex-guard")) n++;
+            }
+            iters++;
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        } while (secs < 0.5);
+        printf("  %-8s %8.2f GB/s  (%zu matching records)\n",
+               "strcasestr", (double)len * iters / secs / 1e9, n);
+    }
+
+    free(text);
+    free(raw);
+    free(hits);
+}
+
+/**
+ * Seed users[idx]'s live counters from its stored record.
+ */
+void counters_from_user(int idx) {
+    atomic_store(&user_counters[idx].credits, users[idx].credits);
+    atomic_store(&user_counters[idx].score,   users[idx].score);
+}
+
+/**
+ * Flag unsaved counter changes for the checkpointer. The flag is only
+ * written when clear, so concurrent bumps don't all bounce its cache line.
+ * The seq_cst bump and load guarantee that if a set flag is seen, the
+ * checkpointer's later exchange and counter reads still see the bump.
+ */
+static void mark_counters_dirty() {
+    if (!atomic_load(&counters_dirty)) atomic_store(&counters_dirty, 1);
+}
+
+/**
+ * Lock-free reward bumps; the checkpointer persists them later.
+ */
+void add_credits(int idx, int delta) {
+    atomic_fetch_add(&user_counters[idx].credits, delta);
+    mark_counters_dirty();
+}
+
+void add_score(int idx, int delta) {
+    atomic_fetch_add(&user_counters[idx].score, delta);
+    mark_counters_dirty();
+}
+
+int get_credits(int idx) {
+    return atomic_load(&user_counters[idx].credits);
+}
+
+int get_score(int idx) {
+    return atomic_load(&user_counters[idx].score);
+}
+
+/**
+ * Move user u to its sorted place in w->rank[] after its score changed.
+ * Costs the number of positions it moves, not the number of users.
+ */
+static void window_reposition(ScoreWindow *w, int u) {
+    int i = w->pos[u];
+    while (i > 0 && w->score[w->rank[i - 1]] < w->score[u]) {
+        int v = w->rank[i - 1];
+        w->rank[i] = v;
+        w->pos[v]  = i;
+        i--;
+    }
+    while (i < w->ranked - 1 && w->score[w->rank[i + 1]] > w->score[u]) {
+        int v = w->rank[i + 1];
+        w->rank[i] = v;
+        w->pos[v]  = i;
+        i++;
+    }
+    w->rank[i] = u;
+    w->pos[u]  = i;
+}
+
+/**
+ * Apply a score/event delta for user u to one window, adding the user to
+ * or dropping it from the ranking as its event count becomes non-zero/zero.
+ */
+static void window_adjust(ScoreWindow *w, int u, int dscore, int devents) {
+    if (w->events[u] == 0 && devents > 0) {
+        w->pos[u]  = w->ranked;
+        w->rank[w->ranked++] = u;
+    }
+    w->score[u]  += dscore;
+    w->events[u] += devents;
+
+    if (w->events[u] > 0) {
+        window_reposition(w, u);
+        return;
+    }
+    // No events left in the window: shift the tail up over the user
+    for (int i = w->pos[u]; i < w->ranked - 1; i++) {
+        w->rank[i] = w->rank[i + 1];
+        w->pos[w->rank[i]] = i;
+    }
+    w->ranked--;
+    w->score[u] = 0;
+}
+
+/**
+ * Open buckets up to bucket id `now`, expiring from each window the
+ * buckets that slide out of it. Caller holds window_mutex.
+ */
+static void window_advance(int64_t now) {
+    if (bucket_now < 0 || now - bucket_now >= SCORE_BUCKETS) {
+        // First use, or idle for longer than the longest window
+        memset(score_buckets, 0, sizeof(score_buckets));
+        for (int b = 0; b < SCORE_BUCKETS; b++) score_buckets[b].id = -1;
+        for (int w = 0; w < WINDOW_COUNT; w++) {
+            memset(score_windows[w].score,  0, sizeof(score_windows[w].score));
+            memset(score_windows[w].events, 0, sizeof(score_windows[w].events));
+            score_windows[w].ranked = 0;
+        }
+        bucket_now = now;
+        return;
+    }
+
+    while (bucket_now < now) {
+        bucket_now++;
+        for (int w = 0; w < WINDOW_COUNT; w++) {
+            ScoreBucket *old = &score_buckets[(bucket_now - score_windows[w].buckets)
+                                              % SCORE_BUCKETS];
+            if (old->id != bucket_now - score_windows[w].buckets) continue;
+            for (int i = 0; i < old->nusers; i++) {
+                int u = old->users[i];
+                window_adjust(&score_windows[w], u, -old->delta[u], -old->events[u]);
+            }
+        }
+        // The slot leaving the longest window is reused for the new bucket
+        ScoreBucket *b = &score_buckets[bucket_now % SCORE_BUCKETS];
+        for (int i = 0; i < b->nusers; i++) {
+            b->delta[b->users[i]]  = 0;
+            b->events[b->users[i]] = 0;
+        }
+        b->nusers = 0;
+        b->id     = bucket_now;
+    }
+}
+
+/**
+ * Record `events` ratings worth `score` for user u at time ts (seconds).
+ * Events older than the longest window are ignored.
+ * Caller holds window_mutex.
+ */
+static void window_add(int u, int score, int events, int64_t ts) {
+    int64_t id = ts / SCORE_BUCKET_SECONDS;
+    if (id > bucket_now) window_advance(id);
+    if (bucket_now - id >= SCORE_BUCKETS || u < 0 || u >= MAX_USERS) return;
+
+    ScoreBucket *b = &score_buckets[id % SCORE_BUCKETS];
+    if (b->id != id) {
+        // Unused since a reset; nothing older can still live in this slot
+        b->nusers = 0;
+        memset(b->delta,  0, sizeof(b->delta));
+        memset(b->events, 0, sizeof(b->events));
+        b->id = id;
+    }
+    if (b->events[u] == 0) b->users[b->nusers++] = u;
+    b->delta[u]  += score;
+    b->events[u] += events;
+
+    for (int w = 0; w < WINDOW_COUNT; w++) {
+        if (bucket_now - id < score_windows[w].buckets) {
+            window_adjust(&score_windows[w], u, score, events);
+        }
+    }
+}
+
+/**
+ * Record one rating for the windowed leaderboards, queue it for
+ * ratings.log and return the event for replication.
+ * Caller holds questions_mutex (so replication stays ordered).
+ */
+RatingEvent window_record(int u, int score) {
+    RatingEvent ev = { time(NULL), u, score, 1 };
+
+    pthread_mutex_lock(&window_mutex);
+    window_add(u, score, 1, ev.ts);
+    if (ratings_log_fd >= 0) {
+        if (pending_count == pending_cap) {
+            int cap = pending_cap ? pending_cap * 2 : 256;
+            RatingEvent *grown = realloc(pending_events, sizeof(RatingEvent) * cap);
+            if (grown) {
+                pending_events = grown;
+                pending_cap    = cap;
+            }
+        }
+        if (pending_count < pending_cap) pending_events[pending_count++] = ev;
+    }
+    pthread_mutex_unlock(&window_mutex);
+    return ev;
+}
+
+/**
+ * Copy the best k users of a window (expiring stale buckets first).
+ * Reads straight off the maintained ranking, so it costs O(k).
+ */
+int window_top(int window, int k, int *out_users, int *out_scores) {
+    pthread_mutex_lock(&window_mutex);
+    window_advance(time(NULL) / SCORE_BUCKET_SECONDS);
+    ScoreWindow *w = &score_windows[window];
+    int n = k < w->ranked ? k : w->ranked;
+    for (int i = 0; i < n; i++) {
+        out_users[i]  = w->rank[i];
+        out_scores[i] = w->score[w->rank[i]];
+    }
+    pthread_mutex_unlock(&window_mutex);
+    return n;
+}
+
+/**
+ * Apply an event received from the primary.
+ */
+void window_apply(const RatingEvent *ev) {
+    pthread_mutex_lock(&window_mutex);
+    window_add(ev->user, ev->score, ev->events, ev->ts);
+    pthread_mutex_unlock(&window_mutex);
+}
+
+/**
+ * Append queued rating events to ratings.log (called by the checkpointer).
+ */
+void flush_rating_events() {
+    pthread_mutex_lock(&window_mutex);
+    RatingEvent *events = pending_events;
+    int count = pending_count;
+    pending_events = NULL;
+    pending_count = pending_cap = 0;
+    pthread_mutex_unlock(&window_mutex);
+
+    if (count > 0 &&
+        write(ratings_log_fd, events, sizeof(RatingEvent) * count) < 0) {
+        perror("ratings.log");
+    }
+    free(events);
+}
+
+/**
+ * fsync the working directory so a rename into it survives a power loss.
+ */
+void sync_directory() {
+    int dir = open(".", O_RDONLY);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+}
+
+/**
+ * Rebuild the windows from ratings.log, compacting away events older than
+ * the longest window, and keep the log open for appends.
+ */
+void ratings_log_open() {
+    int64_t now    = time(NULL);
+    int64_t cutoff = now - (int64_t)SCORE_BUCKETS * SCORE_BUCKET_SECONDS;
+    FILE *in  = fopen("ratings.log", "rb");
+    FILE *out = fopen("ratings.log.tmp", "wb");
+    if (!out) {
+        perror("ratings.log");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_lock(&window_mutex);
+    window_advance(now / SCORE_BUCKET_SECONDS);
+    RatingEvent ev;
+    int ok = 1;
+    while (in && fread(&ev, sizeof(ev), 1, in) == 1) {
+        if (ev.ts < cutoff) continue;
+        window_add(ev.user, ev.score, ev.events, ev.ts);
+        if (ok && fwrite(&ev, sizeof(ev), 1, out) != 1) ok = 0;
+    }
+    pthread_mutex_unlock(&window_mutex);
+
+    // Swap in the compacted log only once it is on disk; on any error the
+    // old log is kept as it is
+    if (in) fclose(in);
+    ok = ok && fflush(out) == 0 && fsync(fileno(out)) == 0;
+    if (fclose(out) != 0 || !ok) {
+        perror("ratings.log.tmp");
+        unlink("ratings.log.tmp");
+    } else if (rename("ratings.log.tmp", "ratings.log") != 0) {
+        perror("ratings.log");
+    } else {
+        sync_directory();
+    }
+    ratings_log_fd = open("ratings.log", O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (ratings_log_fd < 0) {
+        perror("ratings.log");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Per-(bucket, user) aggregates of every live bucket, for replication
+ * snapshots. Caller frees the result.
+ */
+RatingEvent *window_export(int *count) {
+    pthread_mutex_lock(&window_mutex);
+    int n = 0;
+    for (int b = 0; b < SCORE_BUCKETS; b++) n += score_buckets[b].nusers;
+    RatingEvent *out = malloc(sizeof(RatingEvent) * (n ? n : 1));
+    n = 0;
+    for (int b = 0; out && b < SCORE_BUCKETS; b++) {
+        ScoreBucket *bk = &score_buckets[b];
+        if (bk->id < 0) continue;
+        for (int i = 0; i < bk->nusers; i++) {
+            int u = bk->users[i];
+            RatingEvent ev = { bk->id * SCORE_BUCKET_SECONDS, u,
+                               bk->delta[u], bk->events[u] };
+            out[n++] = ev;
+        }
+    }
+    pthread_mutex_unlock(&window_mutex);
+    *count = n;
+    return out;
+}
+
+/**
+ * Replace all windows with the given aggregates (follower snapshot).
+ */
+void window_import(const RatingEvent *events, int count) {
+    pthread_mutex_lock(&window_mutex);
+    bucket_now = -1;
+    window_advance(time(NULL) / SCORE_BUCKET_SECONDS);
+    for (int i = 0; i < count; i++) {
+        window_add(events[i].user, events[i].score, events[i].events, events[i].ts);
+    }
+    pthread_mutex_unlock(&window_mutex);
+}
+
+/**
+ * Load persisted users & questions from disk at startup.
+ */
+void load_data() {
+    FILE *fp;
+    if ((fp = fopen("users.dat", "rb"))) {
+        fread(&user_count, sizeof(int), 1, fp);
+        fread(users,       sizeof(User), user_count, fp);
+        fclose(fp);
+    }
+    for (int i = 0; i < user_count; i++) counters_from_user(i);
+
+    // questions.dat doubles as the segment file for cold answer bodies:
+    // only headers are loaded, answers are paged in by answers_get().
+    segment_fd = open("questions.dat", O_RDWR | O_CREAT, 0644);
+    if (segment_fd < 0) {
+        perror("questions.dat");
+        exit(EXIT_FAILURE);
+    }
+    if (pread(segment_fd, &question_count, sizeof(int), 0) != sizeof(int) ||
+        question_count < 0 || question_count > MAX_QUESTIONS) {
+        question_count = 0;
+    }
+    Question q;
+    for (int i = 0; i < question_count; i++) {
+        if (store_read_record(i, &q) < 0) {
+            question_count = i;
+            break;
+        }
+        header_from_record(&questions[i], &q);
+        corpus_update(i);
+    }
+}
+
+/**
+ * Copy users[] for save_users(). Caller holds users_mutex.
+ */
+void snapshot_users(UsersSnapshot *snap) {
+    snap->version = ++users_version;
+    snap->count   = user_count;
+    memcpy(snap->users, users, sizeof(User) * user_count);
+}
+
+/**
+ * Save a users[] snapshot to disk. Written to a temporary file, synced and
+ * renamed over users.dat, then the directory is synced, so even a power
+ * loss leaves either the old or the new checkpoint. Called without
+ * users_mutex, so the fsyncs never hold up LOGIN or REGISTER; a snapshot
+ * older than the last one saved is skipped.
+ */
+void save_users(const UsersSnapshot *snap) {
+    static uint64_t saved_version = 0;   // guarded by save_mutex
+
+    pthread_mutex_lock(&save_mutex);
+    if (snap->version <= saved_version) {
+        pthread_mutex_unlock(&save_mutex);
+        return;
+    }
+    FILE *fp = fopen("users.dat.tmp", "wb");
+    if (!fp) {
+        pthread_mutex_unlock(&save_mutex);
+        return;
+    }
+    fwrite(&snap->count, sizeof(int), 1, fp);
+    fwrite(snap->users,  sizeof(User), snap->count, fp);
+    int ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (fclose(fp) != 0 || !ok) {
+        perror("users.dat.tmp");
+        pthread_mutex_unlock(&save_mutex);
+        return;
+    }
+    if (rename("users.dat.tmp", "users.dat") != 0) {
+        perror("users.dat");
+        pthread_mutex_unlock(&save_mutex);
+        return;
+    }
+
+    sync_directory();
+    saved_version = snap->version;
+    pthread_mutex_unlock(&save_mutex);
+}
+
+/**
+ * Find a user by username; return index or -1 if not found.
+ */
+int find_user(const char *username) {
+    for (int i = 0; i < user_count; i++) {
+        if (strcmp(users[i].username, username) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Send a simple status|message response back to client.
+ * Every reply ends with a NUL byte, so clients can read replies of any
+ * length up to the terminator.
+ */
+void send_response(int sock, const char *status, const char *message) {
+    char buffer[BUFFER_SIZE];
+    snprintf(buffer, sizeof(buffer), "%s|%s", status, message);
+    send(sock, buffer, strlen(buffer) + 1, MSG_NOSIGNAL);
+}
+
+/**
+ * Current wall-clock time in milliseconds.
+ */
+int64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Send exactly len bytes; return 0 on success, -1 on error.
+ */
+int send_all(int sock, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = send(sock, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p   += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * Receive exactly len bytes; return 0 on success, -1 on error/EOF.
+ */
+int recv_all(int sock, void *data, size_t len) {
+    char *p = data;
+    while (len > 0) {
+        ssize_t n = recv(sock, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p   += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * Append a record to the primary's mutation log and wake the senders.
+ * Caller must hold the mutex protecting the data being logged.
+ */
+static void repl_append(uint32_t type, int idx, const void *body, size_t len) {
+    if (!repl_listen_path) return;
+
+    pthread_mutex_lock(&repl_mutex);
+    ReplRecord *rec = &repl_log[(repl_lsn + 1) % REPL_LOG_SLOTS];
+    rec->hdr.type  = type;
+    rec->hdr.idx   = idx;
+    rec->hdr.count = 0;
+    rec->hdr.len   = len;
+    rec->hdr.lsn   = repl_lsn + 1;
+    rec->hdr.ts_ms = now_ms();
+    memcpy(&rec->body, body, len);
+    repl_lsn++;
+    pthread_cond_broadcast(&repl_cond);
+    pthread_mutex_unlock(&repl_mutex);
+}
+
+/**
+ * Log users[idx] for followers. Caller holds users_mutex.
+ */
+void repl_log_user(int idx) {
+    repl_append(REPL_USER, idx, &users[idx], sizeof(User));
+}
+
+/**
+ * Log questions[idx] with its pinned answer set for followers.
+ * Caller holds questions_mutex.
+ */
+void repl_log_question(int idx, const AnswerSet *a) {
+    if (!repl_listen_path) return;
+    Question q;
+    store_assemble(idx, a, &q);
+    repl_append(REPL_QUESTION, idx, &q, sizeof(Question));
+}
+
+/**
+ * Append a rating event for the followers' windowed leaderboards.
+ */
+void repl_log_rating(const RatingEvent *ev) {
+    repl_append(REPL_RATING, ev->user, ev, sizeof(RatingEvent));
+}
+
+/**
+ * Ship a consistent snapshot of the whole store to a follower.
+ * Returns the LSN the snapshot corresponds to, or 0 on send failure.
+ */
+static uint64_t repl_send_snapshot(int sock) {
+    static User snap_users[MAX_USERS];
+    static pthread_mutex_t snap_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    // Writers append to the log while holding these locks, so every
+    // record up to snap_lsn is reflected in the copy and none after it.
+    // Question records are written through, so the segment file is current.
+    pthread_mutex_lock(&snap_mutex);
+    pthread_mutex_lock(&questions_mutex);
+    pthread_mutex_lock(&users_mutex);
+    int ucount = user_count;
+    int qcount = question_count;
+    memcpy(snap_users, users, sizeof(User) * ucount);
+    for (int i = 0; i < ucount; i++) {
+        snap_users[i].credits = get_credits(i);
+        snap_users[i].score   = get_score(i);
+    }
+    Question *snap_questions = malloc(sizeof(Question) * (qcount ? qcount : 1));
+    int ok = snap_questions &&
+             pread(segment_fd, snap_questions, sizeof(Question) * qcount,
+                   segment_offset(0)) == (ssize_t)(sizeof(Question) * qcount);
+    int rcount;
+    RatingEvent *snap_ratings = window_export(&rcount);
+    ok = ok && snap_ratings;
+    pthread_mutex_lock(&repl_mutex);
+    uint64_t snap_lsn = repl_lsn;
+    pthread_mutex_unlock(&repl_mutex);
+    pthread_mutex_unlock(&users_mutex);
+    pthread_mutex_unlock(&questions_mutex);
+
+    ReplHeader hdr = { REPL_SNAPSHOT_BEGIN, ucount, qcount, 0, snap_lsn, snap_lsn, now_ms() };
+    ok = ok && send_all(sock, &hdr, sizeof(hdr)) == 0;
+
+    for (int i = 0; ok && i < ucount; i++) {
+        ReplHeader uh = { REPL_USER, i, 0, sizeof(User), snap_lsn, snap_lsn, hdr.ts_ms };
+        ok = send_all(sock, &uh, sizeof(uh)) == 0 &&
+             send_all(sock, &snap_users[i], sizeof(User)) == 0;
+    }
+    for (int i = 0; ok && i < qcount; i++) {
+        ReplHeader qh = { REPL_QUESTION, i, 0, sizeof(Question), snap_lsn, snap_lsn, hdr.ts_ms };
+        ok = send_all(sock, &qh, sizeof(qh)) == 0 &&
+             send_all(sock, &snap_questions[i], sizeof(Question)) == 0;
+    }
+    for (int i = 0; ok && i < rcount; i++) {
+        ReplHeader rh = { REPL_RATING, i, 0, sizeof(RatingEvent), snap_lsn, snap_lsn, hdr.ts_ms };
+        ok = send_all(sock, &rh, sizeof(rh)) == 0 &&
+             send_all(sock, &snap_ratings[i], sizeof(RatingEvent)) == 0;
+    }
+    if (ok) {
+        ReplHeader eh = { REPL_SNAPSHOT_END, 0, 0, 0, snap_lsn, snap_lsn, hdr.ts_ms };
+        ok = send_all(sock, &eh, sizeof(eh)) == 0;
+    }
+    free(snap_questions);
+    free(snap_ratings);
+    pthread_mutex_unlock(&snap_mutex);
+
+    return ok ? snap_lsn + 1 : 0;
+}
+
+/**
+ * Primary-side thread: streams the mutation log to one follower.
+ * A follower that falls more than REPL_LOG_SLOTS behind is re-snapshotted.
+ */
+void *repl_sender(void *arg) {
+    int sock = (int)(intptr_t)arg;
+    ReplRecord rec;
+
+    pthread_mutex_lock(&repl_mutex);
+    repl_followers++;
+    pthread_mutex_unlock(&repl_mutex);
+
+    // next = LSN of the next record to ship; snapshot returns 0 on failure
+    uint64_t next = repl_send_snapshot(sock);
+
+    while (next) {
+        pthread_mutex_lock(&repl_mutex);
+        if (repl_lsn < next) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += REPL_HEARTBEAT_MS / 1000;
+            pthread_cond_timedwait(&repl_cond, &repl_mutex, &deadline);
+        }
+        if (repl_lsn < next) {
+            ReplHeader hb = { REPL_HEARTBEAT, 0, 0, 0, repl_lsn, repl_lsn, now_ms() };
+            pthread_mutex_unlock(&repl_mutex);
+            if (send_all(sock, &hb, sizeof(hb)) < 0) break;
+            continue;
+        }
+        if (repl_lsn - next >= REPL_LOG_SLOTS) {
+            // Follower lagged past the ring; start over from a snapshot
+            pthread_mutex_unlock(&repl_mutex);
+            next = repl_send_snapshot(sock);
+            continue;
+        }
+        ReplRecord *slot = &repl_log[next % REPL_LOG_SLOTS];
+        rec.hdr = slot->hdr;
+        rec.hdr.head_lsn = repl_lsn;
+        memcpy(&rec.body, &slot->body, slot->hdr.len);
+        pthread_mutex_unlock(&repl_mutex);
+
+        if (send_all(sock, &rec.hdr, sizeof(rec.hdr)) < 0 ||
+            send_all(sock, &rec.body, rec.hdr.len) < 0) break;
+        next++;
+    }
+
+    pthread_mutex_lock(&repl_mutex);
+    repl_followers--;
+    pthread_mutex_unlock(&repl_mutex);
+    close(sock);
+    return NULL;
+}
+
+/**
+ * Primary-side thread: accepts follower connections on repl_listen_path.
+ */
+void *repl_listener(void *arg) {
+    (void)arg;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("replication socket failed");
+        return NULL;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, repl_listen_path, sizeof(addr.sun_path)-1);
+    unlink(repl_listen_path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, MAX_CLIENTS) < 0) {
+        perror("replication bind failed");
+        close(fd);
+        return NULL;
+    }
+    printf("Replication log available on %s\n", repl_listen_path);
+
+    while (1) {
+        int sock = accept(fd, NULL, NULL);
+        if (sock < 0) continue;
+
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, repl_sender, (void *)(intptr_t)sock) != 0) {
+            close(sock);
+        } else {
+            pthread_detach(tid);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Follower-side: apply one record from the primary's stream.
+ * During a snapshot, records are staged and swapped in at SNAPSHOT_END
+ * so readers never observe a half-loaded store.
+ */
+static int repl_apply(int sock, const ReplHeader *hdr,
+                      User *stage_users, int *stage_fd,
+                      int *staging, int *stage_ucount, int *stage_qcount)
+{
+    static ReplRecord rec;
+    static RatingEvent *stage_ratings = NULL;   // snapshot bucket aggregates
+    static int stage_rcount = 0, stage_rcap = 0;
+
+    if (hdr->len > sizeof(rec.body)) return -1;
+    if (hdr->len && recv_all(sock, &rec.body, hdr->len) < 0) return -1;
+
+    int64_t now = now_ms();
+    pthread_mutex_lock(&repl_mutex);
+    repl_contact_ms = now;
+    if (hdr->type == REPL_SNAPSHOT_BEGIN) {
+        // Every stream starts with a snapshot, and a restarted primary
+        // numbers its LSNs from zero again
+        repl_primary_lsn   = hdr->head_lsn;
+        repl_lsn           = 0;
+        repl_applied_ts_ms = hdr->ts_ms;
+    } else if (hdr->head_lsn > repl_primary_lsn) {
+        repl_primary_lsn = hdr->head_lsn;
+    }
+    pthread_mutex_unlock(&repl_mutex);
+
+    switch (hdr->type) {
+    case REPL_SNAPSHOT_BEGIN:
+        if (hdr->idx < 0 || hdr->idx > MAX_USERS ||
+            hdr->count < 0 || hdr->count > MAX_QUESTIONS) return -1;
+        *staging      = 1;
+        *stage_ucount = hdr->idx;
+        *stage_qcount = hdr->count;
+        stage_rcount  = 0;
+        return 0;
+
+    case REPL_SNAPSHOT_END:
+        if (!*staging) return -1;
+        pthread_mutex_lock(&questions_mutex);
+        pthread_mutex_lock(&users_mutex);
+        memcpy(users, stage_users, sizeof(User) * *stage_ucount);
+        for (int i = 0; i < *stage_ucount; i++) counters_from_user(i);
+        user_count = *stage_ucount;
+
+        // The staged file becomes the segment; the old one is emptied and
+        // reused for the next snapshot
+        for (int i = 0; i < MAX_QUESTIONS; i++) answers_invalidate(i);
+        int old_fd = segment_fd;
+        segment_fd = *stage_fd;
+        *stage_fd  = old_fd;
+        if (ftruncate(old_fd, 0) < 0) perror("segment truncate");
+        question_count = *stage_qcount;
+        for (int i = 0; i < question_count; i++) {
+            Question q;
+            if (store_read_record(i, &q) < 0) memset(&q, 0, sizeof(q));
+            header_from_record(&questions[i], &q);
+        }
+        pwrite(segment_fd, &question_count, sizeof(int), 0);
+        corpus_count = 0;
+        corpus_len   = 0;
+        for (int i = 0; i < question_count; i++) corpus_update(i);
+        window_import(stage_ratings, stage_rcount);
+        pthread_mutex_unlock(&users_mutex);
+        pthread_mutex_unlock(&questions_mutex);
+        *staging = 0;
+        break;
+
+    case REPL_USER:
+        if (hdr->idx < 0 || hdr->idx >= MAX_USERS ||
+            hdr->len != sizeof(User)) return -1;
+        if (*staging) {
+            stage_users[hdr->idx] = rec.body.user;
+            return 0;
+        }
+        pthread_mutex_lock(&users_mutex);
+        users[hdr->idx] = rec.body.user;
+        counters_from_user(hdr->idx);
+        if (hdr->idx >= user_count) user_count = hdr->idx + 1;
+        pthread_mutex_unlock(&users_mutex);
+        break;
+
+    case REPL_QUESTION:
+        if (hdr->idx < 0 || hdr->idx >= MAX_QUESTIONS ||
+            hdr->len != sizeof(Question)) return -1;
+        if (*staging) {
+            return pwrite(*stage_fd, &rec.body.question, sizeof(Question),
+                          segment_offset(hdr->idx)) == (ssize_t)sizeof(Question) ? 0 : -1;
+        }
+        pthread_mutex_lock(&questions_mutex);
+        if (hdr->idx >= question_count) question_count = hdr->idx + 1;
+        store_write_record(hdr->idx, &rec.body.question);
+        header_from_record(&questions[hdr->idx], &rec.body.question);
+        answers_invalidate(hdr->idx);
+        corpus_update(hdr->idx);
+        pthread_mutex_unlock(&questions_mutex);
+        break;
+
+    case REPL_RATING:
+        if (hdr->len != sizeof(RatingEvent)) return -1;
+        if (*staging) {
+            if (stage_rcount == stage_rcap) {
+                int cap = stage_rcap ? stage_rcap * 2 : 256;
+                RatingEvent *grown = realloc(stage_ratings, sizeof(RatingEvent) * cap);
+                if (!grown) return -1;
+                stage_ratings = grown;
+                stage_rcap    = cap;
+            }
+            stage_ratings[stage_rcount++] = rec.body.rating;
+            return 0;
+        }
+        window_apply(&rec.body.rating);
+        break;
+
+    case REPL_HEARTBEAT:
+        return 0;
+
+    default:
+        return -1;
+    }
+
+    pthread_mutex_lock(&repl_mutex);
+    repl_lsn           = hdr->lsn;
+    repl_applied_ts_ms = hdr->ts_ms;
+    pthread_mutex_unlock(&repl_mutex);
+    return 0;
+}
+
+/**
+ * Follower-side thread: connects to the primary, applies its snapshot and
+ * then tails the mutation stream. Reconnects every second on failure.
+ */
+void *repl_follower(void *arg) {
+    (void)arg;
+    // Snapshot questions are staged in a second segment file rather than
+    // in memory, so a follower's resident set stays within --cache-bytes
+    User *stage_users = malloc(sizeof(User) * MAX_USERS);
+    int   stage_fd    = store_temp_file();
+    if (!stage_users) {
+        perror("replication malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    while (1) {
+        int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, repl_follow_path, sizeof(addr.sun_path)-1);
+
+        if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            if (sock >= 0) close(sock);
+            sleep(1);
+            continue;
+        }
+
+        pthread_mutex_lock(&repl_mutex);
+        repl_connected = 1;
+        pthread_mutex_unlock(&repl_mutex);
+        printf("Following primary at %s\n", repl_follow_path);
+
+        int staging = 0, stage_ucount = 0, stage_qcount = 0;
+        ReplHeader hdr;
+        while (recv_all(sock, &hdr, sizeof(hdr)) == 0) {
+            if (repl_apply(sock, &hdr, stage_users, &stage_fd,
+                           &staging, &stage_ucount, &stage_qcount) < 0) break;
+        }
+
+        pthread_mutex_lock(&repl_mutex);
+        repl_connected = 0;
+        pthread_mutex_unlock(&repl_mutex);
+        close(sock);
+        printf("Lost primary, retrying...\n");
+        sleep(1);
+    }
+    return NULL;
+}
+
+/**
+ * Handle REPLSTATUS
+ * Primary:  OK|primary|lsn|followers
+ * Follower: OK|follower|applied_lsn|primary_lsn|lag_records|lag_ms|contact_age_ms|connected
+ * lag_ms is the age of the newest applied record while behind, 0 when caught up.
+ */
+void handle_repl_status(ClientSession *session) {
+    char resp[BUFFER_SIZE];
+    int64_t now = now_ms();
+
+    pthread_mutex_lock(&repl_mutex);
+    if (server_role == ROLE_PRIMARY) {
+        snprintf(resp, sizeof(resp), "OK|primary|%llu|%d",
+                 (unsigned long long)repl_lsn, repl_followers);
+    } else {
+        uint64_t behind = repl_primary_lsn > repl_lsn ? repl_primary_lsn - repl_lsn : 0;
+        int64_t lag_ms  = behind ? now - repl_applied_ts_ms : 0;
+        int64_t contact = repl_contact_ms ? now - repl_contact_ms : -1;
+        snprintf(resp, sizeof(resp), "OK|follower|%llu|%llu|%llu|%lld|%lld|%d",
+                 (unsigned long long)repl_lsn,
+                 (unsigned long long)repl_primary_lsn,
+                 (unsigned long long)behind,
+                 (long long)(lag_ms > 0 ? lag_ms : 0),
+                 (long long)contact,
+                 repl_connected);
+    }
+    pthread_mutex_unlock(&repl_mutex);
+
+    send(session->sock, resp, strlen(resp) + 1, MSG_NOSIGNAL);
+}
+
+/**
+ * Handle CACHESTATS
+ * Returns: OK|hits|misses|hit_rate_pct|evictions|resident_bytes|budget_bytes
+ */
+void handle_cache_stats(ClientSession *session) {
+    uint64_t hits = 0, misses = 0, evictions = 0;
+    size_t bytes = 0;
+
+    pthread_mutex_lock(&questions_mutex);
+    hits      = answer_cache.hits;
+    misses    = answer_cache.misses;
+    evictions = answer_cache.evictions;
+    bytes     = answer_cache.bytes;
+    pthread_mutex_unlock(&questions_mutex);
+
+    char resp[BUFFER_SIZE];
+    double rate = hits + misses ? 100.0 * hits / (hits + misses) : 0.0;
+    snprintf(resp, sizeof(resp), "OK|%llu|%llu|%.1f|%llu|%zu|%zu",
+             (unsigned long long)hits, (unsigned long long)misses, rate,
+             (unsigned long long)evictions, bytes, cache_budget);
+    send(session->sock, resp, strlen(resp) + 1, MSG_NOSIGNAL);
+}
+
+/**
+ * Fold the live counters into users[], ship changed users to followers
+ * and snapshot the result for save_users(). Caller holds users_mutex.
+ */
+void checkpoint_counters(UsersSnapshot *snap) {
+    for (int i = 0; i < user_count; i++) {
+        int credits = get_credits(i);
+        int score   = get_score(i);
+        if (credits != users[i].credits || score != users[i].score) {
+            users[i].credits = credits;
+            users[i].score   = score;
+            repl_log_user(i);
+        }
+    }
+    snapshot_users(snap);
+}
+
+/**
+ * Checkpointer thread: persists counter changes at most
+ * CHECKPOINT_INTERVAL_MS after they happen. A crash loses at most that
+ * window of credit/score bumps; question records are written through and
+ * are not affected.
+ */
+void *checkpointer(void *arg) {
+    (void)arg;
+    while (1) {
+        usleep(CHECKPOINT_INTERVAL_MS * 1000);
+        if (!atomic_exchange(&counters_dirty, 0)) continue;
+
+        UsersSnapshot snap;
+        pthread_mutex_lock(&users_mutex);
+        checkpoint_counters(&snap);
+        pthread_mutex_unlock(&users_mutex);
+        save_users(&snap);
+        flush_rating_events();   // every rating also bumps a score
+    }
+    return NULL;
+}
+
+/**
+ * Signal thread: on SIGINT/SIGTERM take a final checkpoint and exit, so a
+ * clean shutdown never loses counter updates.
+ */
+void *shutdown_waiter(void *arg) {
+    sigset_t *set = (sigset_t *)arg;
+    int sig;
+    sigwait(set, &sig);
+
+    if (server_role == ROLE_PRIMARY) {
+        UsersSnapshot snap;
+        pthread_mutex_lock(&users_mutex);
+        checkpoint_counters(&snap);
+        pthread_mutex_unlock(&users_mutex);
+        save_users(&snap);
+        flush_rating_events();
+    }
+    printf("Shutting down (signal %d)\n", sig);
+    exit(0);
+}
+
+// Session table: slab of pooled sessions plus a hierarchical timer wheel
+ClientSession session_pool[MAX_SESSIONS];
+ClientSession *session_free = NULL;
+ClientSession *timer_wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+uint64_t wheel_tick      = 0;   // seconds since startup, advanced by the reaper
+uint64_t next_session_id = 1;
+int      live_sessions   = 0;
+
+pthread_mutex_t sessions_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Unlink a session from whichever wheel slot holds it. O(1).
+ * Caller holds sessions_mutex.
+ */
+static void timer_cancel(ClientSession *s) {
+    if (s->timer_level < 0) return;
+    if (s->timer_prev) s->timer_prev->timer_next = s->timer_next;
+    else timer_wheel[s->timer_level][s->timer_slot] = s->timer_next;
+    if (s->timer_next) s->timer_next->timer_prev = s->timer_prev;
+    s->timer_prev  = s->timer_next = NULL;
+    s->timer_level = -1;
+}
+
+/**
+ * Place a session in the wheel slot for its expiry tick. O(1).
+ * Caller holds sessions_mutex.
+ */
+static void timer_insert(ClientSession *s) {
+    uint64_t delta = s->timer_expires - wheel_tick;
+    int level, slot;
+
+    if (delta < WHEEL_SLOTS) {
+        level = 0;
+        slot  = s->timer_expires & (WHEEL_SLOTS - 1);
+    } else {
+        // Keep clear of the level-1 slot that has already cascaded
+        if (delta >= (uint64_t)WHEEL_SLOTS * (WHEEL_SLOTS - 1)) {
+            s->timer_expires = wheel_tick + WHEEL_SLOTS * (WHEEL_SLOTS - 1) - 1;
+        }
+        level = 1;
+        slot  = (s->timer_expires >> WHEEL_BITS) & (WHEEL_SLOTS - 1);
+    }
+
+    s->timer_level = level;
+    s->timer_slot  = slot;
+    s->timer_prev  = NULL;
+    s->timer_next  = timer_wheel[level][slot];
+    if (s->timer_next) s->timer_next->timer_prev = s;
+    timer_wheel[level][slot] = s;
+}
+
+/**
+ * (Re)arm a session's timeout `seconds` from now.
+ * Caller holds sessions_mutex.
+ */
+static void timer_schedule(ClientSession *s, int seconds) {
+    timer_cancel(s);
+    if (s->expired) return;
+    s->timer_expires = wheel_tick + (seconds > 0 ? seconds : 1);
+    timer_insert(s);
+}
+
+/**
+ * Advance the wheel one tick and expire every session due at it.
+ * Expired sockets are shut down so the blocked handler thread wakes,
+ * sees EOF and releases the session itself.
+ * Caller holds sessions_mutex.
+ */
+static void timer_tick() {
+    wheel_tick++;
+
+    // Cascade the level-1 slot whose range starts at this tick
+    if ((wheel_tick & (WHEEL_SLOTS - 1)) == 0) {
+        int slot = (wheel_tick >> WHEEL_BITS) & (WHEEL_SLOTS - 1);
+        ClientSession *s = timer_wheel[1][slot];
+        timer_wheel[1][slot] = NULL;
+        while (s) {
+            ClientSession *next = s->timer_next;
+            timer_insert(s);
+            s = next;
+        }
+    }
+
+    int slot = wheel_tick & (WHEEL_SLOTS - 1);
+    ClientSession *s = timer_wheel[0][slot];
+    while (s) {
+        ClientSession *next = s->timer_next;
+        if (s->timer_expires <= wheel_tick) {
+            timer_cancel(s);
+            s->expired = 1;
+            shutdown(s->sock, SHUT_RDWR);
+        }
+        s = next;
+    }
+}
+
+/**
+ * Reaper thread: drives the timer wheel off the monotonic clock.
+ */
+void *session_reaper(void *arg) {
+    (void)arg;
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (1) {
+        sleep(1);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t target = now.tv_sec - start.tv_sec;
+
+        pthread_mutex_lock(&sessions_mutex);
+        while (wheel_tick < target) timer_tick();
+        pthread_mutex_unlock(&sessions_mutex);
+    }
+    return NULL;
+}
+
+/**
+ * Build the free list over the session pool.
+ */
+void sessions_init() {
+    for (int i = MAX_SESSIONS - 1; i >= 0; i--) {
+        session_pool[i].in_use      = 0;
+        session_pool[i].timer_level = -1;
+        session_pool[i].next_free   = session_free;
+        session_free = &session_pool[i];
+    }
+}
+
+/**
+ * Take a session from the pool and arm its read timeout.
+ * Returns NULL when every slot is in use.
+ */
+ClientSession *session_alloc(int sock, struct sockaddr_in *addr) {
+    pthread_mutex_lock(&sessions_mutex);
+    ClientSession *s = session_free;
+    if (s) {
+        session_free      = s->next_free;
+        s->sock           = sock;
+        s->addr           = *addr;
+        s->user_idx       = -1;
+        s->authenticated  = 0;
+        s->id             = next_session_id++;
+        s->in_use         = 1;
+        s->expired        = 0;
+        s->connected_tick = wheel_tick;
+        s->active_tick    = wheel_tick;
+        s->timer_level    = -1;
+        timer_schedule(s, SESSION_READ_TIMEOUT);
+        live_sessions++;
+    }
+    pthread_mutex_unlock(&sessions_mutex);
+    return s;
+}
+
+/**
+ * Record activity on a session and push its idle deadline out.
+ */
+void session_touch(ClientSession *s) {
+    pthread_mutex_lock(&sessions_mutex);
+    s->active_tick = wheel_tick;
+    timer_schedule(s, SESSION_IDLE_TIMEOUT);
+    pthread_mutex_unlock(&sessions_mutex);
+}
+
+/**
+ * Set or clear (idx < 0) the user logged in on a session.
+ */
+void session_set_user(ClientSession *s, int idx) {
+    pthread_mutex_lock(&sessions_mutex);
+    s->user_idx      = idx;
+    s->authenticated = idx >= 0;
+    pthread_mutex_unlock(&sessions_mutex);
+}
+
+/**
+ * Close a session's socket and return it to the pool.
+ */
+void session_release(ClientSession *s) {
+    pthread_mutex_lock(&sessions_mutex);
+    timer_cancel(s);
+    close(s->sock);
+    s->in_use    = 0;
+    s->next_free = session_free;
+    session_free = s;
+    live_sessions--;
+    pthread_mutex_unlock(&sessions_mutex);
+}
+
+// Traffic capture: handlers push into a lock-free ring, one thread writes it
+CaptureSlot capture_ring[CAPTURE_SLOTS];
+_Atomic size_t   capture_head    = 0;
+_Atomic uint64_t capture_dropped = 0;
+FILE *capture_fp = NULL;
+
+// The writer sleeps on capture_wake while the ring is empty; producers only
+// take capture_lock when they see capture_sleeping set
+_Atomic int     capture_sleeping = 0;
+pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  capture_wake = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Current wall-clock time in microseconds.
+ */
+int64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Queue one capture record. Never blocks: when the ring is full the
+ * record is dropped and counted. Safe to call from any thread.
+ */
+void capture_event(uint32_t type, uint64_t conn, const char *data, size_t len) {
+    if (!capture_fp) return;
+
+    // Large records (whole BATCH bodies) are copied to the heap up front
+    char *spill = NULL;
+    if (len > BUFFER_SIZE) {
+        if (!(spill = malloc(len))) {
+            atomic_fetch_add_explicit(&capture_dropped, 1, memory_order_relaxed);
+            return;
+        }
+        memcpy(spill, data, len);
+    }
+
+    size_t pos = atomic_load_explicit(&capture_head, memory_order_relaxed);
+    CaptureSlot *slot;
+    for (;;) {
+        slot = &capture_ring[pos & (CAPTURE_SLOTS - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&capture_head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            atomic_fetch_add_explicit(&capture_dropped, 1, memory_order_relaxed);
+            free(spill);
+            return;
+        } else {
+            pos = atomic_load_explicit(&capture_head, memory_order_relaxed);
+        }
+    }
+
+    slot->rec.ts_us = now_us();
+    slot->rec.conn  = conn;
+    slot->rec.type  = type;
+    slot->rec.len   = len;
+    slot->spill     = spill;
+    if (!spill) memcpy(slot->data, data, len);
+
+    // Passwords never reach the trace: REGISTER|user|pw -> REGISTER|user|*
+    if (type == CAPTURE_CMD && !spill &&
+        (strncmp(slot->data, "REGISTER|", 9) == 0 ||
+         strncmp(slot->data, "LOGIN|", 6) == 0)) {
+        char *sep = memchr(slot->data, '|', len);
+        sep = sep ? memchr(sep + 1, '|', slot->data + len - sep - 1) : NULL;
+        if (sep) {
+            sep[1] = '*';
+            slot->rec.len = sep - slot->data + 2;
+        }
+    }
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    // Pairs with the writer's store to capture_sleeping before it rechecks
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&capture_sleeping, memory_order_relaxed)) {
+        pthread_mutex_lock(&capture_lock);
+        pthread_cond_signal(&capture_wake);
+        pthread_mutex_unlock(&capture_lock);
+    }
+}
+
+/**
+ * Capture writer thread: drains the ring into the trace file.
+ */
+void *capture_writer(void *arg) {
+    (void)arg;
+    size_t tail = 0;
+    uint64_t reported = 0;
+
+    while (1) {
+        CaptureSlot *slot = &capture_ring[tail & (CAPTURE_SLOTS - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != tail + 1) {
+            // Ring empty: flush, then sleep until a producer publishes
+            fflush(capture_fp);
+            uint64_t dropped = atomic_load_explicit(&capture_dropped,
+                                                    memory_order_relaxed);
+            if (dropped != reported) {
+                fprintf(stderr, "capture: %llu records dropped\n",
+                        (unsigned long long)dropped);
+                reported = dropped;
+            }
+
+            pthread_mutex_lock(&capture_lock);
+            atomic_store(&capture_sleeping, 1);
+            while (atomic_load(&slot->seq) != tail + 1) {
+                pthread_cond_wait(&capture_wake, &capture_lock);
+            }
+            atomic_store(&capture_sleeping, 0);
+            pthread_mutex_unlock(&capture_lock);
+            continue;
+        }
+
+        fwrite(&slot->rec, sizeof(slot->rec), 1, capture_fp);
+        fwrite(slot->spill ? slot->spill : slot->data, 1, slot->rec.len, capture_fp);
+        free(slot->spill);
+        slot->spill = NULL;
+        atomic_store_explicit(&slot->seq, tail + CAPTURE_SLOTS,
+                              memory_order_release);
+        tail++;
+    }
+    return NULL;
+}
+
+/**
+ * Open the trace file and start the writer thread.
+ */
+void capture_start(const char *path) {
+    capture_fp = fopen(path, "wb");
+    if (!capture_fp) {
+        perror("capture file");
+        exit(EXIT_FAILURE);
+    }
+    fwrite(CAPTURE_MAGIC, 1, sizeof(CAPTURE_MAGIC), capture_fp);
+    for (size_t i = 0; i < CAPTURE_SLOTS; i++) {
+        atomic_init(&capture_ring[i].seq, i);
+    }
 
-// Global data and mutexes
-User users[MAX_USERS];
-Question questions[MAX_QUESTIONS];
-int user_count = 0;
-int question_count = 0;
+    pthread_t tid;
+    pthread_create(&tid, NULL, capture_writer, NULL);
+    pthread_detach(tid);
+    printf("Capturing traffic to %s\n", path);
+}
 
-pthread_mutex_t users_mutex     = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t questions_mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * Handle SESSIONS (managers only)
+ * Returns: OK|count;id|address:port|user|idle_s|age_s;...
+ */
+void handle_sessions(ClientSession *session) {
+    if (!session->authenticated) {
+        send_response(session->sock, "ERR", "Not authenticated");
+        return;
+    }
+    pthread_mutex_lock(&users_mutex);
+    int is_manager = users[session->user_idx].is_manager;
+    pthread_mutex_unlock(&users_mutex);
+    if (!is_manager) {
+        send_response(session->sock, "ERR", "Not a manager");
+        return;
+    }
+
+    // Every live session is listed: id, address, name, two tick counts
+    size_t cap = 32 + (size_t)MAX_SESSIONS * (3 * 20 + INET_ADDRSTRLEN + 8 + 50 + 8);
+    char *resp = malloc(cap);
+    if (!resp) {
+        send_response(session->sock, "ERR", "Out of memory");
+        return;
+    }
+    pthread_mutex_lock(&sessions_mutex);
+    size_t pos = snprintf(resp, cap, "OK|%d;", live_sessions);
+
+    for (int i = 0; i < MAX_SESSIONS && pos < cap; i++) {
+        ClientSession *s = &session_pool[i];
+        if (!s->in_use) continue;
+
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &s->addr.sin_addr, ip, sizeof(ip));
+        // users[] is append-only, so the name at user_idx is stable
+        const char *name = s->authenticated ? users[s->user_idx].username : "-";
+        int n = snprintf(resp + pos, cap - pos,
+                         "%llu|%s:%d|%s|%llu|%llu;",
+                         (unsigned long long)s->id, ip, ntohs(s->addr.sin_port),
+                         name,
+                         (unsigned long long)(wheel_tick - s->active_tick),
+                         (unsigned long long)(wheel_tick - s->connected_tick));
+        pos += (n > 0 ? n : 0);
+    }
+    pthread_mutex_unlock(&sessions_mutex);
+
+    send_all(session->sock, resp, strlen(resp) + 1);
+    free(resp);
+}
 
 /**
- * Hash a plaintext password using SHA-256 and output as hex string.
+ * Encode 0..MAX_QUESTIONS once, so replies can point at digits instead of
+ * formatting them per response.
  */
-void hash_password(const char *password, char *output) {
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256((const unsigned char *)password, strlen(password), hash);
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        sprintf(output + i*2, "%02x", hash[i]);
+void responses_init() {
+    for (int i = 0; i <= MAX_QUESTIONS; i++) {
+        decimal_len[i] = snprintf(decimal_text[i], sizeof(decimal_text[i]), "%d", i);
     }
-    output[SHA256_DIGEST_LENGTH*2] = '\0';
 }
 
 /**
- * Load persisted users & questions from disk at startup.
+ * Start a scatter-gather reply with room for `cap` fragments and
+ * `scratch` bytes of copied text.
  */
-void load_data() {
-    FILE *fp;
-    if ((fp = fopen("users.dat", "rb"))) {
-        fread(&user_count, sizeof(int), 1, fp);
-        fread(users,       sizeof(User), user_count, fp);
-        fclose(fp);
+int iol_init(IoList *l, int cap, size_t scratch) {
+    cap++;        // room for the terminating NUL (see send_response)
+    scratch++;
+    l->iov = malloc(sizeof(struct iovec) * cap + scratch);
+    if (!l->iov) return -1;
+    l->count       = 0;
+    l->cap         = cap;
+    l->scratch     = (char *)(l->iov + cap);
+    l->used        = 0;
+    l->scratch_cap = scratch;
+    return 0;
+}
+
+// Copy bytes into scratch, growing the last fragment when it ends there
+static void iol_copy(IoList *l, const char *src, size_t len) {
+    if (len > l->scratch_cap - l->used) return;
+    char *dst = l->scratch + l->used;
+    memcpy(dst, src, len);
+    l->used += len;
+
+    struct iovec *last = l->count ? &l->iov[l->count - 1] : NULL;
+    if (last && (char *)last->iov_base + last->iov_len == dst) {
+        last->iov_len += len;
+    } else if (l->count < l->cap) {
+        l->iov[l->count].iov_base = dst;
+        l->iov[l->count].iov_len  = len;
+        l->count++;
     }
-    if ((fp = fopen("questions.dat", "rb"))) {
-        fread(&question_count, sizeof(int), 1, fp);
-        fread(questions,        sizeof(Question), question_count, fp);
-        fclose(fp);
+}
+
+// Reference stored text in place; it must stay valid until the reply is sent
+static void iol_text(IoList *l, const char *text, size_t len) {
+    if (len < IOL_COPY_MAX || l->count == l->cap) {
+        iol_copy(l, text, len);
+        return;
     }
+    l->iov[l->count].iov_base = (void *)text;
+    l->iov[l->count].iov_len  = len;
+    l->count++;
+}
+
+static void iol_num(IoList *l, int n) {
+    iol_copy(l, decimal_text[n], decimal_len[n]);
 }
 
 /**
- * Save users array back to disk.
+ * Append idx|question|author|answer_count; for questions[i]: at most
+ * two fragments and IOL_ROW_SCRATCH bytes of scratch. Caller holds
+ * questions_mutex until the reply is sent.
  */
-void save_users() {
-    FILE *fp = fopen("users.dat", "wb");
-    if (!fp) return;
-    fwrite(&user_count, sizeof(int), 1, fp);
-    fwrite(users,       sizeof(User), user_count, fp);
-    fclose(fp);
+void iol_question_row(IoList *l, int i) {
+    iol_num(l, i);
+    iol_copy(l, "|", 1);
+    iol_text(l, questions[i].question, strnlen(questions[i].question, sizeof(questions[i].question)));
+    iol_copy(l, "|", 1);
+    iol_copy(l, questions[i].author, strnlen(questions[i].author, sizeof(questions[i].author)));
+    iol_copy(l, "|", 1);
+    iol_num(l, questions[i].answer_count);
+    iol_copy(l, ";", 1);
 }
 
 /**
- * Save questions array back to disk.
+ * Send fragments with sendmsg(), IOV_MAX at a time, for as long as the
+ * socket accepts them without blocking. On return iov and count describe
+ * what is left (trimmed past partial writes). Returns -1 on error.
  */
-void save_questions() {
-    FILE *fp = fopen("questions.dat", "wb");
-    fwrite(&question_count, sizeof(int), 1, fp);
-    fwrite(questions,        sizeof(Question), question_count, fp);
-    fclose(fp);
+static int send_iov_nonblock(int sock, struct iovec **iov, int *count) {
+    while (*count > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = *iov;
+        msg.msg_iovlen = *count < IOV_MAX ? *count : IOV_MAX;
+
+        ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n < 0 || (n == 0 && (*iov)->iov_len > 0)) return -1;
+
+        // Drop fully sent fragments, then trim a partially sent one
+        while (*count > 0 && (size_t)n >= (*iov)->iov_len) {
+            n -= (*iov)->iov_len;
+            (*iov)++;
+            (*count)--;
+        }
+        if (*count > 0) {
+            (*iov)->iov_base = (char *)(*iov)->iov_base + n;
+            (*iov)->iov_len -= n;
+        }
+    }
+    return 0;
 }
 
 /**
- * Find a user by username; return index or -1 if not found.
+ * Terminate and send a reply built with iol_init() while the caller
+ * still holds the locks keeping its fragments valid. Never blocks:
+ * whatever the socket buffer cannot take is copied to the heap, and
+ * iol_finish() sends it once the caller has dropped its locks.
  */
-int find_user(const char *username) {
-    for (int i = 0; i < user_count; i++) {
-        if (strcmp(users[i].username, username) == 0) {
-            return i;
+void iol_send(int sock, IoList *l) {
+    iol_copy(l, "", 1);
+    struct iovec *iov = l->iov;
+    int count = l->count;
+    l->rest     = NULL;
+    l->rest_len = 0;
+
+    if (send_iov_nonblock(sock, &iov, &count) == 0 && count > 0) {
+        for (int i = 0; i < count; i++) l->rest_len += iov[i].iov_len;
+        l->rest = malloc(l->rest_len);
+        if (l->rest) {
+            size_t pos = 0;
+            for (int i = 0; i < count; i++) {
+                memcpy(l->rest + pos, iov[i].iov_base, iov[i].iov_len);
+                pos += iov[i].iov_len;
+            }
+        } else {
+            // Out of memory: fall back to blocking under the lock
+            for (int i = 0; i < count; i++) {
+                if (send_all(sock, iov[i].iov_base, iov[i].iov_len) < 0) break;
+            }
+            l->rest_len = 0;
         }
     }
-    return -1;
+    free(l->iov);
+    l->iov = NULL;
 }
 
 /**
- * Send a simple status|message response back to client.
+ * Send the tail iol_send() could not deliver; call without locks held.
  */
-void send_response(int sock, const char *status, const char *message) {
-    char buffer[BUFFER_SIZE];
-    snprintf(buffer, sizeof(buffer), "%s|%s", status, message);
-    send(sock, buffer, strlen(buffer), 0);
+void iol_finish(int sock, IoList *l) {
+    if (l->rest) send_all(sock, l->rest, l->rest_len);
+    free(l->rest);
+    l->rest = NULL;
 }
 
 /**
@@ -140,10 +2477,15 @@ void handle_register(int sock, char *username, char *password) {
     new_user.is_manager = 0;
     new_user.score      = 0;
 
-    users[user_count++] = new_user;
-    save_users();
+    users[user_count] = new_user;
+    counters_from_user(user_count);
+    user_count++;
+    repl_log_user(user_count - 1);
+    UsersSnapshot snap;
+    snapshot_users(&snap);
 
     pthread_mutex_unlock(&users_mutex);
+    save_users(&snap);
     send_response(sock, "OK", "Registration successful");
 }
 
@@ -162,28 +2504,27 @@ void handle_login(ClientSession *session, char *username, char *password) {
 
     char hash[SHA256_DIGEST_LENGTH*2 + 1];
     hash_password(password, hash);
+    int match = strcmp(users[idx].password_hash, hash) == 0;
+
+    // Return OK|username|current_credits
+    char resp[BUFFER_SIZE];
+    snprintf(resp, sizeof(resp), "OK|%s|%d",
+             users[idx].username, get_credits(idx));
+    pthread_mutex_unlock(&users_mutex);
 
-    if (strcmp(users[idx].password_hash, hash) == 0) {
-        session->user_idx      = idx;
-        session->authenticated = 1;
-        // Return OK|username|current_credits
-        char resp[BUFFER_SIZE];
-        snprintf(resp, sizeof(resp), "OK|%s|%d",
-                 users[idx].username, users[idx].credits);
-        send(session->sock, resp, strlen(resp), 0);
+    if (match) {
+        session_set_user(session, idx);
+        send(session->sock, resp, strlen(resp) + 1, MSG_NOSIGNAL);
     } else {
         send_response(session->sock, "ERR", "Invalid password");
     }
-
-    pthread_mutex_unlock(&users_mutex);
 }
 
 /**
  * Handle LOGOUT
  */
 void handle_logout(ClientSession *session) {
-    session->authenticated = 0;
-    session->user_idx      = -1;
+    session_set_user(session, -1);
     send_response(session->sock, "OK", "Logged out");
 }
 
@@ -203,23 +2544,29 @@ void handle_post_question(ClientSession *session, char *question_text) {
         return;
     }
 
+    AnswerSet *a = answers_create(question_count);
+    if (!a) {
+        send_response(session->sock, "ERR", "Storage error");
+        pthread_mutex_unlock(&questions_mutex);
+        return;
+    }
+
     // Add question
-    Question *q = &questions[question_count];
+    QuestionHeader *q = &questions[question_count];
+    memset(q, 0, sizeof(*q));
     strncpy(q->question, question_text, sizeof(q->question)-1);
     strncpy(q->author, users[session->user_idx].username, sizeof(q->author)-1);
-    q->answer_count = 0;
-    memset(q->ratings, 0, sizeof(q->ratings));
     question_count++;
+    corpus_update(question_count - 1);
+    store_write_question(question_count - 1, a);
+    repl_log_question(question_count - 1, a);
+    answers_put(a);
 
-    // Reward credits
-    pthread_mutex_lock(&users_mutex);
-    users[session->user_idx].credits += 10;
-    save_users();
-    pthread_mutex_unlock(&users_mutex);
-
-    save_questions();
     pthread_mutex_unlock(&questions_mutex);
 
+    // Reward credits
+    add_credits(session->user_idx, 10);
+
     send_response(session->sock, "OK", "Question posted (+10 credits)");
 }
 
@@ -240,7 +2587,7 @@ void handle_answer(ClientSession *session, char *qidx_str, char *answer_text) {
         return;
     }
 
-    Question *q = &questions[qidx];
+    QuestionHeader *q = &questions[qidx];
     if (q->answer_count >= MAX_ANSWERS) {
         send_response(session->sock, "ERR", "Answer limit reached");
         pthread_mutex_unlock(&questions_mutex);
@@ -248,21 +2595,24 @@ void handle_answer(ClientSession *session, char *qidx_str, char *answer_text) {
     }
 
     // Add answer
-    int aidx = q->answer_count++;
-    strncpy(q->answers[aidx], answer_text, sizeof(q->answers[aidx])-1);
-    strncpy(q->answer_authors[aidx],
-            users[session->user_idx].username,
-            sizeof(q->answer_authors[aidx])-1);
-
-    // Reward credits
-    pthread_mutex_lock(&users_mutex);
-    users[session->user_idx].credits += 5;
-    save_users();
-    pthread_mutex_unlock(&users_mutex);
+    AnswerSet *a = answers_get(qidx);
+    if (!a || answers_append(a, users[session->user_idx].username,
+                             answer_text) < 0) {
+        if (a) answers_put(a);
+        send_response(session->sock, "ERR", "Storage error");
+        pthread_mutex_unlock(&questions_mutex);
+        return;
+    }
+    q->answer_count++;
+    store_write_question(qidx, a);
+    repl_log_question(qidx, a);
+    answers_put(a);
 
-    save_questions();
     pthread_mutex_unlock(&questions_mutex);
 
+    // Reward credits
+    add_credits(session->user_idx, 5);
+
     send_response(session->sock, "OK", "Answer added (+5 credits)");
 }
 
@@ -273,67 +2623,205 @@ void handle_answer(ClientSession *session, char *qidx_str, char *answer_text) {
 void handle_list_questions(ClientSession *session) {
     pthread_mutex_lock(&questions_mutex);
 
-    char resp[BUFFER_SIZE] = "OK|";
-    size_t pos = strlen(resp);
-
-    for (int i = 0; i < question_count && pos < BUFFER_SIZE - 100; i++) {
-        int n = snprintf(resp + pos, BUFFER_SIZE - pos,
-                         "%d|%s|%s|%d;",
-                         i,
-                         questions[i].question,
-                         questions[i].author,
-                         questions[i].answer_count);
-        pos += (n > 0 ? n : 0);
+    // Rows point into questions[]; the lock is held until they are sent
+    // or copied out
+    IoList l;
+    if (iol_init(&l, 1 + 2 * question_count,
+                 8 + (size_t)IOL_ROW_SCRATCH * question_count) < 0) {
+        pthread_mutex_unlock(&questions_mutex);
+        send_response(session->sock, "ERR", "Out of memory");
+        return;
     }
+    iol_copy(&l, "OK|", 3);
+    for (int i = 0; i < question_count; i++) iol_question_row(&l, i);
 
-    send(session->sock, resp, strlen(resp), 0);
+    iol_send(session->sock, &l);
     pthread_mutex_unlock(&questions_mutex);
+    iol_finish(session->sock, &l);
 }
 
 /**
- * Handle SEARCH|keyword
- * Returns first matching question + answers or "Question not found"
+ * Handle SEARCH|keyword[|all]
+ * Returns first matching question + answers or "Question not found".
+ * With "all": OK|count;idx|question|author|answer_count;... for every match.
  */
-void handle_search(ClientSession *session, char *keyword) {
+void handle_search(ClientSession *session, char *keyword, char *mode) {
     if (!session->authenticated) {
         send_response(session->sock, "ERR", "Not authenticated");
         return;
     }
+    if (!keyword) {
+        send_response(session->sock, "ERR", "Missing keyword");
+        return;
+    }
 
     pthread_mutex_lock(&questions_mutex);
-    char resp[BUFFER_SIZE] = "OK|";
-    int found = 0;
+    int matches[MAX_QUESTIONS];
+    int all = mode && strcmp(mode, "all") == 0;
+    int n = search_questions(keyword, matches, all ? MAX_QUESTIONS : 1);
+
+    IoList l;
+    int rc = all ? iol_init(&l, 1 + 2 * n, 16 + (size_t)IOL_ROW_SCRATCH * n)
+                 : iol_init(&l, 2 + 2 * MAX_ANSWERS,
+                            IOL_ROW_SCRATCH + MAX_ANSWERS * IOL_COPY_MAX);
+    if (rc < 0) {
+        pthread_mutex_unlock(&questions_mutex);
+        send_response(session->sock, "ERR", "Out of memory");
+        return;
+    }
+    iol_copy(&l, "OK|", 3);
+
+    AnswerSet *a = NULL;
+    if (all) {
+        iol_num(&l, n);
+        iol_copy(&l, ";", 1);
+        for (int k = 0; k < n; k++) iol_question_row(&l, matches[k]);
+    } else if (n == 0) {
+        iol_copy(&l, "Question not found", 18);
+    } else {
+        // Question text, then answers pointing into the pinned answer set
+        int i = matches[0];
+        iol_text(&l, questions[i].question,
+                 strnlen(questions[i].question, sizeof(questions[i].question)));
+        iol_copy(&l, "|", 1);
+        a = questions[i].answer_count > 0 ? answers_get(i) : NULL;
+        if (a) {
+            for (int j = 0; j < a->count; j++) {
+                iol_text(&l, a->text[j], strlen(a->text[j]));
+                if (j < a->count - 1) iol_copy(&l, ";", 1);
+            }
+        } else {
+            iol_copy(&l, "No answers yet", 14);
+        }
+    }
 
-    for (int i = 0; i < question_count; i++) {
-        if (strcasestr(questions[i].question, keyword)) {
-            // Append question text
-            strncat(resp, questions[i].question,
-                    BUFFER_SIZE - strlen(resp) - 1);
-            strncat(resp, "|", BUFFER_SIZE - strlen(resp) - 1);
-            // Append answers or placeholder
-            if (questions[i].answer_count > 0) {
-                for (int j = 0; j < questions[i].answer_count; j++) {
-                    strncat(resp, questions[i].answers[j],
-                            BUFFER_SIZE - strlen(resp) - 1);
-                    if (j < questions[i].answer_count - 1)
-                        strncat(resp, ";", BUFFER_SIZE - strlen(resp) - 1);
-                }
-            } else {
-                strncat(resp, "No answers yet",
-                        BUFFER_SIZE - strlen(resp) - 1);
+    // Anything the socket did not take is copied out before unpinning
+    iol_send(session->sock, &l);
+    if (a) answers_put(a);
+    pthread_mutex_unlock(&questions_mutex);
+    iol_finish(session->sock, &l);
+}
+
+// Drains the benchmark's socketpair so the sender never blocks for long
+static void *bench_drain(void *arg) {
+    int fd = *(int *)arg;
+    char buf[65536];
+    while (read(fd, buf, sizeof(buf)) > 0);
+    return NULL;
+}
+
+/**
+ * --bench-responses N: build and send LISTQ and SEARCH replies over N
+ * synthetic questions through a socketpair, comparing copying assembly
+ * (snprintf/strncat into one buffer, without the old 2048-byte cap) with
+ * the scatter-gather path. Reports sender CPU time per response.
+ */
+void bench_responses(int nq) {
+    if (nq < 1 || nq > MAX_QUESTIONS) {
+        fprintf(stderr, "--bench-responses takes 1..%d questions\n", MAX_QUESTIONS);
+        exit(EXIT_FAILURE);
+    }
+    responses_init();
+    store_open_anonymous();
+
+    // Questions of ~200 bytes; question 0 also gets MAX_ANSWERS full answers
+    static Question q;
+    for (int i = 0; i < nq; i++) {
+        memset(&q, 0, sizeof(q));
+        int n = snprintf(q.question, sizeof(q.question), "Bench question %d: ", i);
+        memset(q.question + n, 'x', 200 - n);
+        snprintf(q.author, sizeof(q.author), "bench_author_%d", i % 50);
+        if (i == 0) {
+            q.answer_count = MAX_ANSWERS;
+            for (int j = 0; j < MAX_ANSWERS; j++) {
+                memset(q.answers[j], 'a' + j % 26, sizeof(q.answers[j]) - 1);
+                strcpy(q.answer_authors[j], "bench_author_0");
             }
-            found = 1;
-            break;
         }
+        question_count = i + 1;
+        store_write_record(i, &q);
+        header_from_record(&questions[i], &q);
+        corpus_update(i);
     }
 
-    if (!found) {
-        strncat(resp, "Question not found",
-                BUFFER_SIZE - strlen(resp) - 1);
+    int sv[2];
+    pthread_t drain_tid;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair failed");
+        exit(EXIT_FAILURE);
     }
+    pthread_create(&drain_tid, NULL, bench_drain, &sv[1]);
 
-    send(session->sock, resp, strlen(resp), 0);
-    pthread_mutex_unlock(&questions_mutex);
+    ClientSession session;
+    memset(&session, 0, sizeof(session));
+    session.sock          = sv[0];
+    session.authenticated = 1;
+
+    size_t cap = (size_t)nq * 320 + MAX_ANSWERS * 260 + 64;
+    char *resp = malloc(cap);
+    if (!resp) {
+        perror("bench malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Response benchmark: %d questions, %d answers on question 0\n",
+           nq, MAX_ANSWERS);
+    for (int r = 0; r < 4; r++) {
+        static const char *names[] = {
+            "LISTQ copy", "LISTQ iovec", "SEARCH copy", "SEARCH iovec"
+        };
+        struct timespec c0, c1, w0, w1;
+        int iters = 0;
+        double wall = 0;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c0);
+        clock_gettime(CLOCK_MONOTONIC, &w0);
+        do {
+            if (r == 0) {
+                // LISTQ as it was built before: one snprintf per row
+                pthread_mutex_lock(&questions_mutex);
+                size_t pos = snprintf(resp, cap, "OK|");
+                for (int i = 0; i < question_count; i++) {
+                    int n = snprintf(resp + pos, cap - pos, "%d|%s|%s|%d;",
+                                     i, questions[i].question, questions[i].author,
+                                     questions[i].answer_count);
+                    pos += (n > 0 ? n : 0);
+                }
+                send_all(sv[0], resp, strlen(resp) + 1);
+                pthread_mutex_unlock(&questions_mutex);
+            } else if (r == 1) {
+                handle_list_questions(&session);
+            } else if (r == 2) {
+                // SEARCH as it was built before: strncat re-scans the reply
+                pthread_mutex_lock(&questions_mutex);
+                int match;
+                search_questions("bench question 0", &match, 1);
+                strcpy(resp, "OK|");
+                strncat(resp, questions[match].question, cap - strlen(resp) - 1);
+                strncat(resp, "|", cap - strlen(resp) - 1);
+                AnswerSet *a = answers_get(match);
+                for (int j = 0; a && j < a->count; j++) {
+                    strncat(resp, a->text[j], cap - strlen(resp) - 1);
+                    if (j < a->count - 1) strncat(resp, ";", cap - strlen(resp) - 1);
+                }
+                if (a) answers_put(a);
+                send_all(sv[0], resp, strlen(resp) + 1);
+                pthread_mutex_unlock(&questions_mutex);
+            } else {
+                handle_search(&session, "bench question 0", NULL);
+            }
+            iters++;
+            clock_gettime(CLOCK_MONOTONIC, &w1);
+            wall = (w1.tv_sec - w0.tv_sec) + (w1.tv_nsec - w0.tv_nsec) / 1e9;
+        } while (wall < 0.5);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c1);
+        double cpu = (c1.tv_sec - c0.tv_sec) + (c1.tv_nsec - c0.tv_nsec) / 1e9;
+        printf("  %-12s %8.2f us CPU/response  (%d responses)\n",
+               names[r], cpu * 1e6 / iters, iters);
+    }
+
+    shutdown(sv[0], SHUT_WR);
+    pthread_join(drain_tid, NULL);
+    free(resp);
 }
 
 /**
@@ -374,9 +2862,17 @@ void handle_rate_answer(ClientSession *session,
         return;
     }
 
+    AnswerSet *a = answers_get(qidx);
+    if (!a) {
+        send_response(session->sock, "ERR", "Storage error");
+        pthread_mutex_unlock(&questions_mutex);
+        return;
+    }
+
     // Find answer author in users[]
-    int author_idx = find_user(questions[qidx].answer_authors[aidx]);
+    int author_idx = find_user(a->author[aidx]);
     if (author_idx < 0) {
+        answers_put(a);
         send_response(session->sock, "ERR", "Answer author not found");
         pthread_mutex_unlock(&questions_mutex);
         return;
@@ -384,15 +2880,310 @@ void handle_rate_answer(ClientSession *session,
 
     // Record rating and update user score
     questions[qidx].ratings[aidx] = score;
+    store_write_question(qidx, a);
+    repl_log_question(qidx, a);
+    answers_put(a);
+    RatingEvent ev = window_record(author_idx, score);
+    repl_log_rating(&ev);
+    pthread_mutex_unlock(&questions_mutex);
+
+    add_score(author_idx, score);
+
+    send_response(session->sock, "OK", "Answer rated");
+}
+
+/**
+ * Parse a non-negative decimal field; return -1 if missing or malformed.
+ */
+static int parse_index(const char *s) {
+    if (!s || !*s) return -1;
+    char *end;
+    long v = strtol(s, &end, 10);
+    return (*end == '\0' && v >= 0 && v <= 1000000) ? (int)v : -1;
+}
+
+/**
+ * Parse one "POST|text", "ANSWER|qidx|text" or "RATE|qidx|aidx|score" line.
+ * Returns NULL on success or an error message.
+ */
+static const char *batch_parse_op(char *line, BatchOp *op) {
+    char *save;
+    char *cmd = strtok_r(line, "|", &save);
+    memset(op, 0, sizeof(*op));
+    if (!cmd) return "Empty operation";
+
+    if (strcmp(cmd, "POST") == 0) {
+        op->type = BATCH_POST;
+        op->text = strtok_r(NULL, "|", &save);
+        if (!op->text) return "Missing question text";
+    } else if (strcmp(cmd, "ANSWER") == 0) {
+        op->type = BATCH_ANSWER;
+        op->qidx = parse_index(strtok_r(NULL, "|", &save));
+        op->text = strtok_r(NULL, "|", &save);
+        if (op->qidx < 0) return "Invalid question index";
+        if (!op->text)    return "Missing answer text";
+    } else if (strcmp(cmd, "RATE") == 0) {
+        op->type  = BATCH_RATE;
+        op->qidx  = parse_index(strtok_r(NULL, "|", &save));
+        op->aidx  = parse_index(strtok_r(NULL, "|", &save));
+        char *score = strtok_r(NULL, "|", &save);
+        if (op->qidx < 0 || op->aidx < 0) return "Invalid indices";
+        if (!score) return "Missing score";
+        op->score = atoi(score);
+    } else {
+        return "Unknown operation";
+    }
+    return NULL;
+}
+
+/**
+ * Handle BATCH|count\n<op>\n<op>...
+ * Each op is a POST, ANSWER or RATE line; ANSWER/RATE may refer to
+ * questions posted earlier in the same batch. The whole batch is
+ * validated against the current store before anything is applied, then
+ * applied under a single acquisition of questions_mutex and users_mutex
+ * with one write per touched question; credit and score bumps go to the
+ * lock-free counters and reach users.dat with the next checkpoint.
+ * Returns: OK|count;i|message;... or ERR|Op i: reason (nothing applied).
+ * The function itself returns -1 if the client went away mid-batch.
+ */
+int handle_batch(ClientSession *session, const char *first, size_t first_len) {
+    // Header line and body exactly as received; both may span segments
+    size_t raw_cap = BATCH_HEADER_MAX + BATCH_MAX_BYTES;
+    char *raw = malloc(raw_cap);
+    if (!raw) {
+        send_response(session->sock, "ERR", "Out of memory");
+        return 0;
+    }
+    size_t len = first_len < raw_cap - 1 ? first_len : raw_cap - 1;
+    memcpy(raw, first, len);
+
+    char *nl;
+    while (!(nl = memchr(raw, '\n', len)) && len < BATCH_HEADER_MAX) {
+        ssize_t n = recv(session->sock, raw + len, raw_cap - 1 - len, 0);
+        if (n <= 0) {
+            free(raw);
+            return -1;
+        }
+        len += n;
+    }
+    int count = -1;
+    if (nl && nl - raw < BATCH_HEADER_MAX) {
+        *nl = '\0';
+        count = parse_index(raw + 6);
+        *nl = '\n';
+    }
+    if (count < 1 || count > BATCH_MAX_OPS) {
+        send_response(session->sock, "ERR", "Invalid batch header");
+        free(raw);
+        return 0;
+    }
+
+    // Read until all `count` op lines have arrived
+    char *body = nl + 1;
+    int lines = 0;
+    for (char *c = body; c < raw + len; c++) lines += *c == '\n';
+    while (lines < count && len < raw_cap - 1) {
+        ssize_t n = recv(session->sock, raw + len, raw_cap - 1 - len, 0);
+        if (n <= 0) {
+            free(raw);
+            return -1;
+        }
+        for (ssize_t i = 0; i < n; i++) lines += raw[len + i] == '\n';
+        len += n;
+    }
+    raw[len] = '\0';
+    capture_event(CAPTURE_CMD, session->id, raw, len);
+
+    BatchOp *ops = malloc(sizeof(BatchOp) * count);
+    if (!ops) {
+        send_response(session->sock, "ERR", "Out of memory");
+        free(raw);
+        return 0;
+    }
+
+    char err[BUFFER_SIZE] = "";
+    if (lines < count) {
+        snprintf(err, sizeof(err), "Expected %d operations, got %d", count, lines);
+    } else if (lines > count || raw[len - 1] != '\n') {
+        // Pipelined commands would otherwise be silently swallowed
+        snprintf(err, sizeof(err), "Unexpected data after %d operations", count);
+    } else if (server_role == ROLE_FOLLOWER) {
+        snprintf(err, sizeof(err), "Read-only replica");
+    } else if (!session->authenticated) {
+        snprintf(err, sizeof(err), "Not authenticated");
+    }
+
+    char *line = body;
+    for (int i = 0; !err[0] && i < count; i++) {
+        char *end = strchr(line, '\n');
+        *end = '\0';
+        const char *msg = batch_parse_op(line, &ops[i]);
+        if (msg) snprintf(err, sizeof(err), "Op %d: %s", i, msg);
+        line = end + 1;
+    }
+    if (err[0]) {
+        send_response(session->sock, "ERR", err);
+        free(raw);
+        free(ops);
+        return 0;
+    }
+
+    // Validate the batch against a simulation of the store
+    static AnswerSet *sets[MAX_QUESTIONS];      // pinned per touched question
+    static int answer_counts[MAX_QUESTIONS];    // simulated answer_count
+    int touched[MAX_QUESTIONS], ntouched = 0;
+
+    // sets[] and answer_counts[] are guarded by questions_mutex
+    pthread_mutex_lock(&questions_mutex);
     pthread_mutex_lock(&users_mutex);
-    users[author_idx].score += score;
-    save_users();
-    pthread_mutex_unlock(&users_mutex);
 
-    save_questions();
+    const char *me = users[session->user_idx].username;
+    int qcount = question_count;
+
+    for (int i = 0; !err[0] && i < count; i++) {
+        BatchOp *op = &ops[i];
+        if (op->type == BATCH_POST) {
+            if (qcount >= MAX_QUESTIONS) {
+                snprintf(err, sizeof(err), "Op %d: Question limit reached", i);
+                break;
+            }
+            op->qidx = qcount++;
+            if (!(sets[op->qidx] = answers_create(op->qidx))) {
+                snprintf(err, sizeof(err), "Op %d: Storage error", i);
+                break;
+            }
+            answer_counts[op->qidx] = 0;
+            touched[ntouched++] = op->qidx;
+            continue;
+        }
+
+        if (op->qidx >= qcount) {
+            snprintf(err, sizeof(err), "Op %d: %s", i,
+                     op->type == BATCH_ANSWER ? "Invalid question index"
+                                              : "Invalid indices");
+            break;
+        }
+        if (!sets[op->qidx]) {
+            if (!(sets[op->qidx] = answers_get(op->qidx))) {
+                snprintf(err, sizeof(err), "Op %d: Storage error", i);
+                break;
+            }
+            answer_counts[op->qidx] = questions[op->qidx].answer_count;
+            touched[ntouched++] = op->qidx;
+        }
+        // Questions posted in this batch are authored by the caller
+        const char *qauthor = op->qidx < question_count
+                              ? questions[op->qidx].author : me;
+
+        if (op->type == BATCH_ANSWER) {
+            if (answer_counts[op->qidx] >= MAX_ANSWERS) {
+                snprintf(err, sizeof(err), "Op %d: Answer limit reached", i);
+                break;
+            }
+            op->aidx = answer_counts[op->qidx]++;
+            op->text_copy   = strndup(op->text, sizeof(((Question *)0)->answers[0]) - 1);
+            op->author_copy = strndup(me, sizeof(((Question *)0)->answer_authors[0]) - 1);
+            if (!op->text_copy || !op->author_copy) {
+                snprintf(err, sizeof(err), "Op %d: Out of memory", i);
+                break;
+            }
+        } else {
+            if (op->aidx >= answer_counts[op->qidx]) {
+                snprintf(err, sizeof(err), "Op %d: Invalid indices", i);
+                break;
+            }
+            if (strcmp(me, qauthor) != 0) {
+                snprintf(err, sizeof(err), "Op %d: Not the question author", i);
+                break;
+            }
+            // The answer author is either stored already or added earlier here
+            const char *aauthor = me;
+            AnswerSet *a = sets[op->qidx];
+            if (op->aidx < a->count) aauthor = a->author[op->aidx];
+            if ((op->author_idx = find_user(aauthor)) < 0) {
+                snprintf(err, sizeof(err), "Op %d: Answer author not found", i);
+                break;
+            }
+        }
+    }
+
+    if (err[0]) {
+        // Nothing has been applied: release pins and drop unused new sets
+        for (int t = 0; t < ntouched; t++) {
+            int q = touched[t];
+            if (q >= question_count) answers_invalidate(q);
+            else answers_put(sets[q]);
+            sets[q] = NULL;
+        }
+        for (int i = 0; i < count; i++) {
+            free(ops[i].text_copy);
+            free(ops[i].author_copy);
+        }
+        pthread_mutex_unlock(&users_mutex);
+        pthread_mutex_unlock(&questions_mutex);
+        send_response(session->sock, "ERR", err);
+        free(raw);
+        free(ops);
+        return 0;
+    }
+
+    // Apply: nothing below can fail
+    size_t cap = 32 + (size_t)count * 64;
+    char *resp = malloc(cap);
+    size_t pos = resp ? snprintf(resp, cap, "OK|%d;", count) : 0;
+
+    for (int i = 0; i < count; i++) {
+        BatchOp *op = &ops[i];
+        char msg[64];
+        if (op->type == BATCH_POST) {
+            QuestionHeader *q = &questions[op->qidx];
+            memset(q, 0, sizeof(*q));
+            strncpy(q->question, op->text, sizeof(q->question)-1);
+            strncpy(q->author, me, sizeof(q->author)-1);
+            question_count++;
+            corpus_update(op->qidx);
+            add_credits(session->user_idx, 10);
+            snprintf(msg, sizeof(msg), "Question %d posted (+10 credits)", op->qidx);
+        } else if (op->type == BATCH_ANSWER) {
+            answers_attach(sets[op->qidx], op->author_copy, op->text_copy);
+            questions[op->qidx].answer_count++;
+            add_credits(session->user_idx, 5);
+            snprintf(msg, sizeof(msg), "Answer %d added (+5 credits)", op->aidx);
+        } else {
+            questions[op->qidx].ratings[op->aidx] = op->score;
+            add_score(op->author_idx, op->score);
+            RatingEvent ev = window_record(op->author_idx, op->score);
+            repl_log_rating(&ev);
+            snprintf(msg, sizeof(msg), "Answer rated");
+        }
+        if (resp) {
+            int n = snprintf(resp + pos, cap - pos, "%d|%s;", i, msg);
+            pos += (n > 0 ? n : 0);
+        }
+    }
+
+    // One persistence pass
+    for (int t = 0; t < ntouched; t++) {
+        int q = touched[t];
+        store_write_question(q, sets[q]);
+        repl_log_question(q, sets[q]);
+        answers_put(sets[q]);
+        sets[q] = NULL;
+    }
+
+    pthread_mutex_unlock(&users_mutex);
     pthread_mutex_unlock(&questions_mutex);
 
-    send_response(session->sock, "OK", "Answer rated");
+    if (resp) {
+        send_all(session->sock, resp, strlen(resp) + 1);
+    } else {
+        send_response(session->sock, "OK", "Batch applied");
+    }
+    free(resp);
+    free(raw);
+    free(ops);
+    return 0;
 }
 
 /**
@@ -402,6 +3193,37 @@ int compare_users(const void *a, const void *b) {
     return ((User *)b)->score - ((User *)a)->score;
 }
 
+/**
+ * Handle LEADER|daily|weekly|monthly[|k]
+ * Returns the top k (default 10) users by score received within the window.
+ */
+void handle_window_leaderboard(ClientSession *session, int window, char *k_str) {
+    int k = k_str ? atoi(k_str) : 10;
+    if (k <= 0 || k > MAX_USERS) {
+        send_response(session->sock, "ERR", "Invalid count");
+        return;
+    }
+
+    int top_users[MAX_USERS], top_scores[MAX_USERS];
+    int n = window_top(window, k, top_users, top_scores);
+
+    // One line per user: rank, name of up to 49 chars and score
+    char resp[64 + 96 * (MAX_USERS + 1)];
+    size_t pos = snprintf(resp, sizeof(resp),
+                          "OK|\n--- %s Leaderboard ---\n%-5s %-20s %-6s\n",
+                          score_windows[window].name, "Rank", "Username", "Score");
+
+    pthread_mutex_lock(&users_mutex);
+    for (int i = 0; i < n; i++) {
+        pos += snprintf(resp + pos, sizeof(resp) - pos,
+                        "%-5d %-20s %-6d\n",
+                        i+1, users[top_users[i]].username, top_scores[i]);
+    }
+    pthread_mutex_unlock(&users_mutex);
+
+    send_all(session->sock, resp, pos + 1);
+}
+
 /**
  * Handle LEADER
  * Returns top 10 users by cumulative score.
@@ -412,6 +3234,7 @@ void handle_leaderboard(ClientSession *session) {
     // Copy and sort
     User sorted[MAX_USERS];
     memcpy(sorted, users, sizeof(User) * user_count);
+    for (int i = 0; i < user_count; i++) sorted[i].score = get_score(i);
     qsort(sorted, user_count, sizeof(User), compare_users);
 
     char resp[BUFFER_SIZE] = "OK|\n--- Leaderboard ---\n";
@@ -427,7 +3250,7 @@ void handle_leaderboard(ClientSession *session) {
                         i+1, sorted[i].username, sorted[i].score);
     }
 
-    send(session->sock, resp, strlen(resp), 0);
+    send(session->sock, resp, strlen(resp) + 1, MSG_NOSIGNAL);
     pthread_mutex_unlock(&users_mutex);
 }
 
@@ -438,50 +3261,89 @@ void *client_handler(void *arg) {
     ClientSession *session = (ClientSession *)arg;
     char buffer[BUFFER_SIZE];
 
+    if (capture_fp) {
+        char peer[INET_ADDRSTRLEN + 8];
+        inet_ntop(AF_INET, &session->addr.sin_addr, peer, INET_ADDRSTRLEN);
+        size_t n = strlen(peer);
+        snprintf(peer + n, sizeof(peer) - n, ":%d", ntohs(session->addr.sin_port));
+        capture_event(CAPTURE_OPEN, session->id, peer, strlen(peer));
+    }
+
     while (1) {
         ssize_t len = recv(session->sock, buffer, sizeof(buffer)-1, 0);
-        if (len <= 0) break;       // client disconnected
+        if (len <= 0) break;       // client disconnected or timed out
         buffer[len] = '\0';
+        session_touch(session);
 
-        // Tokenize command and parameters by '|'
-        char *cmd = strtok(buffer, "|");
+        // BATCH frames its own multi-line body (and records its capture)
+        if (strncmp(buffer, "BATCH|", 6) == 0) {
+            if (handle_batch(session, buffer, len) < 0) break;
+            continue;
+        }
+        capture_event(CAPTURE_CMD, session->id, buffer, len);
+
+        // Tokenize command and parameters by '|'. Fields are pulled out in
+        // order here: strtok() calls as sibling arguments would be evaluated
+        // in an unspecified order.
+        char *cmd  = strtok(buffer, "|");
+        if (!cmd) continue;
+        char *arg1 = strtok(NULL, "|");
+        char *arg2 = strtok(NULL, "|");
+        char *arg3 = strtok(NULL, "|");
+
+        // Followers only serve reads; writes must go to the primary
+        if (server_role == ROLE_FOLLOWER &&
+            (strcmp(cmd, "REGISTER") == 0 || strcmp(cmd, "POST") == 0 ||
+             strcmp(cmd, "ANSWER") == 0   || strcmp(cmd, "RATE") == 0)) {
+            send_response(session->sock, "ERR", "Read-only replica");
+            continue;
+        }
 
         if      (strcmp(cmd, "REGISTER") == 0) {
-            handle_register(session->sock,
-                            strtok(NULL, "|"),
-                            strtok(NULL, "|"));
+            handle_register(session->sock, arg1, arg2);
         }
         else if (strcmp(cmd, "LOGIN") == 0) {
-            handle_login(session,
-                         strtok(NULL, "|"),
-                         strtok(NULL, "|"));
+            handle_login(session, arg1, arg2);
         }
         else if (strcmp(cmd, "LOGOUT") == 0) {
             handle_logout(session);
         }
         else if (strcmp(cmd, "POST") == 0) {
-            handle_post_question(session,
-                                 strtok(NULL, "|"));
+            handle_post_question(session, arg1);
         }
         else if (strcmp(cmd, "ANSWER") == 0) {
-            handle_answer(session,
-                          strtok(NULL, "|"),
-                          strtok(NULL, "|"));
+            handle_answer(session, arg1, arg2);
         }
         else if (strcmp(cmd, "LISTQ") == 0) {
             handle_list_questions(session);
         }
         else if (strcmp(cmd, "SEARCH") == 0) {
-            handle_search(session, strtok(NULL, "|"));
+            handle_search(session, arg1, arg2);
         }
         else if (strcmp(cmd, "RATE") == 0) {
-            handle_rate_answer(session,
-                               strtok(NULL, "|"),
-                               strtok(NULL, "|"),
-                               strtok(NULL, "|"));
+            handle_rate_answer(session, arg1, arg2, arg3);
         }
         else if (strcmp(cmd, "LEADER") == 0) {
-            handle_leaderboard(session);
+            if (!arg1 || strcmp(arg1, "all") == 0) {
+                handle_leaderboard(session);
+            } else if (strcmp(arg1, "daily") == 0) {
+                handle_window_leaderboard(session, WINDOW_DAILY, arg2);
+            } else if (strcmp(arg1, "weekly") == 0) {
+                handle_window_leaderboard(session, WINDOW_WEEKLY, arg2);
+            } else if (strcmp(arg1, "monthly") == 0) {
+                handle_window_leaderboard(session, WINDOW_MONTHLY, arg2);
+            } else {
+                send_response(session->sock, "ERR", "Unknown window");
+            }
+        }
+        else if (strcmp(cmd, "REPLSTATUS") == 0) {
+            handle_repl_status(session);
+        }
+        else if (strcmp(cmd, "SESSIONS") == 0) {
+            handle_sessions(session);
+        }
+        else if (strcmp(cmd, "CACHESTATS") == 0) {
+            handle_cache_stats(session);
         }
         else {
             send_response(session->sock, "ERR", "Unknown command");
@@ -489,21 +3351,124 @@ void *client_handler(void *arg) {
     }
 
     // Cleanup on disconnect
-    close(session->sock);
-    free(session);
+    capture_event(CAPTURE_CLOSE, session->id, NULL, 0);
+    session_release(session);
     return NULL;
 }
 
 /**
  * Program entrypoint: initializes server socket, loads data,
  * then loops forever accepting clients and spawning threads.
+ *
+ * Usage: server [--port N] [--admin USER] [--cache-bytes N] [--capture FILE]
+ *               [--repl-listen PATH | --follow PATH]
+ *   --admin USER        grant USER manager rights (e.g. the SESSIONS command)
+ *   --cache-bytes N     memory budget for resident answer bodies
+ *   --capture FILE      record every command to a trace for replay.c
+ *   --bench-search MB   benchmark the SEARCH kernels on MB of text and exit
+ *   --bench-responses N benchmark LISTQ/SEARCH reply assembly over N questions
+ *   --repl-listen PATH  run as primary and ship mutations to followers
+ *   --follow PATH       run as a read-only follower of the primary at PATH
  */
-int main() {
+int main(int argc, char *argv[]) {
     int server_fd, client_sock;
     struct sockaddr_in address;
     socklen_t addrlen = sizeof(address);
+    int port = PORT;
+    const char *admin = NULL;
+    const char *capture_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--admin") == 0 && i + 1 < argc) {
+            admin = argv[++i];
+        } else if (strcmp(argv[i], "--cache-bytes") == 0 && i + 1 < argc) {
+            cache_budget = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture_path = argv[++i];
+        } else if (strcmp(argv[i], "--bench-search") == 0 && i + 1 < argc) {
+            search_init();
+            bench_search(strtoull(argv[++i], NULL, 10));
+            return 0;
+        } else if (strcmp(argv[i], "--bench-responses") == 0 && i + 1 < argc) {
+            search_init();
+            bench_responses(atoi(argv[++i]));
+            return 0;
+        } else if (strcmp(argv[i], "--repl-listen") == 0 && i + 1 < argc) {
+            repl_listen_path = argv[++i];
+        } else if (strcmp(argv[i], "--follow") == 0 && i + 1 < argc) {
+            repl_follow_path = argv[++i];
+            server_role      = ROLE_FOLLOWER;
+        } else {
+            fprintf(stderr,
+                    "Usage: %s [--port N] [--admin USER] [--cache-bytes N] "
+                    "[--capture FILE] [--bench-search MB] [--bench-responses N] "
+                    "[--repl-listen PATH | --follow PATH]\n",
+                    argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (repl_listen_path && repl_follow_path) {
+        fprintf(stderr, "--repl-listen and --follow are mutually exclusive\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Route SIGINT/SIGTERM to the shutdown thread; every thread created
+    // from here on inherits the blocked mask
+    static sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    // Replies may race with the reaper shutting a socket down; a write to
+    // it must fail with EPIPE, not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    pthread_t stop_tid;
+    pthread_create(&stop_tid, NULL, shutdown_waiter, &stop_signals);
+    pthread_detach(stop_tid);
+
+    search_init();
+    responses_init();
+    if (capture_path) capture_start(capture_path);
+
+    // Pooled sessions are expired by the reaper's timer wheel
+    pthread_t reaper_tid;
+    sessions_init();
+    pthread_create(&reaper_tid, NULL, session_reaper, NULL);
+    pthread_detach(reaper_tid);
+
+    // A follower's store comes entirely from the primary's snapshot
+    pthread_t repl_tid;
+    if (server_role == ROLE_FOLLOWER) {
+        store_open_anonymous();
+        pthread_create(&repl_tid, NULL, repl_follower, NULL);
+        pthread_detach(repl_tid);
+    } else {
+        load_data();
+        ratings_log_open();
+        if (admin) {
+            int idx = find_user(admin);
+            if (idx < 0) {
+                fprintf(stderr, "Unknown admin user %s\n", admin);
+                exit(EXIT_FAILURE);
+            }
+            users[idx].is_manager = 1;
+            UsersSnapshot snap;
+            snapshot_users(&snap);
+            save_users(&snap);
+        }
+        if (repl_listen_path) {
+            pthread_create(&repl_tid, NULL, repl_listener, NULL);
+            pthread_detach(repl_tid);
+        }
 
-    load_data();
+        // Credit/score counters reach users.dat asynchronously
+        pthread_t ckpt_tid;
+        pthread_create(&ckpt_tid, NULL, checkpointer, NULL);
+        pthread_detach(ckpt_tid);
+    }
 
     // Create TCP socket
     if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
@@ -514,7 +3479,7 @@ int main() {
     // Bind to any interface on PORT
     address.sin_family      = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port        = htons(PORT);
+    address.sin_port        = htons(port);
 
     if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
         perror("bind failed");
@@ -527,7 +3492,8 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
-    printf("Server listening on port %d...\n", PORT);
+    printf("Server listening on port %d (%s)...\n", port,
+           server_role == ROLE_PRIMARY ? "primary" : "follower");
 
     while (1) {
         client_sock = accept(server_fd,
@@ -538,24 +3504,19 @@ int main() {
             continue;
         }
 
-        // Allocate session for new client
-        ClientSession *session = malloc(sizeof(ClientSession));
+        // Take a pooled session for the new client
+        ClientSession *session = session_alloc(client_sock, &address);
         if (!session) {
-            perror("malloc failed");
+            send_response(client_sock, "ERR", "Server busy");
             close(client_sock);
             continue;
         }
-        session->sock          = client_sock;
-        session->addr          = address;
-        session->user_idx      = -1;
-        session->authenticated = 0;
 
         // Spawn thread and detach immediately
         pthread_t tid;
         if (pthread_create(&tid, NULL, client_handler, session) != 0) {
             perror("pthread_create failed");
-            close(client_sock);
-            free(session);
+            session_release(session);
         } else {
             pthread_detach(tid);
         }